@@ -0,0 +1,457 @@
+#ifndef AFFINE_TRANSFORM_H
+#define AFFINE_TRANSFORM_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <numbers>
+#include <optional>
+#include <span>
+#include <type_traits>
+
+#include "canvas.hpp"
+#include "canvas_kernels.hpp"
+#include "coverage_raster.hpp"
+#include "geometry.hpp"
+#include "line_raster.hpp"
+#include "scanline_fill.hpp"
+#include "shape_raster.hpp"
+
+// Affine placement of recorded shapes: translations, scales and rotations
+// composed into one 2 x 3 matrix, applied to a command's geometry before it
+// is rasterized.
+// The command is first reduced to vertices in its own coordinates:
+//   polygonal shapes   shape_vertices(), a SQUARE its four corners
+//   circles            points around the outline, more for larger circles
+//   LINE, POINT        their end points
+// Vertices carry subpixel_bits fractional bits, so the outline of a small
+// circle scaled up keeps its shape. The matrix is converted to 16.16 fixed
+// point once, the whole vertex array is transformed in one batch by
+// canvas_kernels::transform_points and the result drawn with
+// rasterize_polygon or rasterize_line. Transformed polygons and lines are
+// drawn by the same rasterizers as any other, so clipping and tiling still
+// match unclipped drawing exactly.
+// Some placements keep the command's own rasterizer: a translation by whole
+// pixels just moves the command, which draws exactly the pixels, sprites
+// included, of the command moved by hand. A round circle under a rotation
+// or uniform scale stays a midpoint circle, and any circle scaled along the
+// axes becomes a midpoint ellipse. rasterize_instances() reduces a command
+// once and draws it at every placement in a list.
+
+// x' = xx * x + xy * y + tx, y' = yx * x + yy * y + ty, in canvas
+// coordinates, so y points down. a * b applies b first, then a.
+struct Affine {
+    double xx{1}, xy{0}, yx{0}, yy{1};
+    double tx{0}, ty{0};
+
+    static constexpr Affine identity() { return {}; }
+    static constexpr Affine translate(const double dx, const double dy) {
+        return {1, 0, 0, 1, dx, dy};
+    }
+    static constexpr Affine scale(const double sx, const double sy) {
+        return {sx, 0, 0, sy, 0, 0};
+    }
+    static constexpr Affine scale(const double s) { return scale(s, s); }
+    // Scales about centre, which stays in place
+    static constexpr Affine scale(const double sx, const double sy,
+                                  const Point centre) {
+        return about(scale(sx, sy), centre);
+    }
+    // Clockwise on screen, as y points down
+    static Affine rotate(const double radians) {
+        const double c = std::cos(radians), s = std::sin(radians);
+        return {c, -s, s, c, 0, 0};
+    }
+    static Affine rotate(const double radians, const Point centre) {
+        return about(rotate(radians), centre);
+    }
+
+    friend constexpr Affine operator*(const Affine& a, const Affine& b) {
+        return {a.xx * b.xx + a.xy * b.yx,
+                a.xx * b.xy + a.xy * b.yy,
+                a.yx * b.xx + a.yy * b.yx,
+                a.yx * b.xy + a.yy * b.yy,
+                a.xx * b.tx + a.xy * b.ty + a.tx,
+                a.yx * b.tx + a.yy * b.ty + a.ty};
+    }
+    // This placement followed by next, for left to right chains like
+    // Affine::scale(2).then(Affine::rotate(a)).then(Affine::translate(x, y))
+    constexpr Affine then(const Affine& next) const { return next * *this; }
+
+    friend constexpr bool operator==(const Affine&, const Affine&) = default;
+
+    constexpr bool is_identity() const { return *this == Affine{}; }
+    constexpr bool is_axis_aligned() const { return xy == 0 && yx == 0; }
+    // A rotation, possibly mirrored, with a uniform scale: equal length,
+    // orthogonal columns, up to the rounding of composed coefficients
+    bool is_similarity() const {
+        const double s = max_scale();
+        const double tolerance{1e-9 * s};
+        return std::abs(std::abs(xx) - std::abs(yy)) <= tolerance &&
+               std::abs(std::abs(xy) - std::abs(yx)) <= tolerance &&
+               std::abs(xx * xy + yx * yy) <= tolerance * s;
+    }
+    // Moves every pixel by the same whole number of pixels
+    constexpr bool is_integer_translation() const {
+        constexpr double limit{1 << 30};
+        return xx == 1 && xy == 0 && yx == 0 && yy == 1 &&
+               tx == static_cast<int>(std::clamp(tx, -limit, limit)) &&
+               ty == static_cast<int>(std::clamp(ty, -limit, limit));
+    }
+
+    // Longest the matrix makes a unit step along either axis
+    double max_scale() const {
+        return std::max(std::hypot(xx, yx), std::hypot(xy, yy));
+    }
+
+    // For inputs with input_bits fractional bits, outputs in whole pixels.
+    // Coefficients saturate at the limits of 16.16 fixed point.
+    canvas_kernels::FixedAffine fixed(const int input_bits = 0) const {
+        using canvas_kernels::FixedAffine;
+        const double unit =
+            std::ldexp(1.0, FixedAffine::fraction_bits - input_bits);
+        const auto coefficient = [unit](const double c) {
+            constexpr double lo{std::numeric_limits<std::int32_t>::min()};
+            constexpr double hi{std::numeric_limits<std::int32_t>::max()};
+            return static_cast<std::int32_t>(
+                std::clamp(std::round(c * unit), lo, hi));
+        };
+        const auto offset = [](const double t) {
+            constexpr double limit{0x1p62};
+            return static_cast<std::int64_t>(
+                std::clamp(std::round(t * FixedAffine::one), -limit, limit));
+        };
+        return {coefficient(xx), coefficient(xy), coefficient(yx),
+                coefficient(yy), offset(tx),      offset(ty)};
+    }
+
+    // p placed by the matrix, rounded like the batch transforms
+    Point apply(const Point p) const {
+        const std::int32_t in[2]{p.x, p.y};
+        std::int32_t out[2];
+        canvas_kernels::detail::transform_scalar(out, in, 1, fixed());
+        return {out[0], out[1]};
+    }
+
+   private:
+    static constexpr Affine about(const Affine& m, const Point centre) {
+        return translate(centre.x, centre.y) * m *
+               translate(-centre.x, -centre.y);
+    }
+};
+
+// Applies m to src, writing dst, which must be at least as long. dst may
+// be src.
+inline void transform_points(std::span<Point> dst, std::span<const Point> src,
+                             const canvas_kernels::FixedAffine& m) {
+    static_assert(std::same_as<int, std::int32_t> &&
+                  sizeof(Point) == 2 * sizeof(std::int32_t) &&
+                  std::is_standard_layout_v<Point>);
+    canvas_kernels::transform_points(
+        {reinterpret_cast<std::int32_t*>(dst.data()), 2 * dst.size()},
+        {reinterpret_cast<const std::int32_t*>(src.data()), 2 * src.size()},
+        m);
+}
+
+namespace affine {
+
+// Fractional bits of the vertices a command is reduced to
+inline constexpr int subpixel_bits{4};
+
+// Most vertices a command is reduced to, the outline of a large circle.
+// Within what rasterize_polygon handles without the heap, and still less
+// than a pixel off the true outline up to a radius of about 800.
+inline constexpr std::size_t max_vertices{scanline::inline_vertices};
+
+// Roughly how many pixels apart a placed circle's outline points are
+inline constexpr double circle_step{4.0};
+
+// What the vertices of a Geometry are
+enum class Outline : std::uint8_t { NONE, POLYGON, LINE, POINT };
+
+// A command reduced to vertices, in 1 / 2^subpixel_bits pixels
+struct Geometry {
+    Outline outline{Outline::NONE};
+    PolygonMode mode{PolygonMode::OUTLINE};
+    std::size_t size{0};
+    std::array<Point, max_vertices> vertices;
+
+    std::span<const Point> view() const { return {vertices.data(), size}; }
+};
+
+constexpr int circle_radius_y(const DrawCommand& cmd) {
+    return cmd.y1 > 0 ? cmd.y1 : cmd.x1;
+}
+
+// Outline points of a circle command placed by a matrix of max_scale()
+// scale, 0 for other shapes
+inline std::size_t circle_vertices(const DrawCommand& cmd,
+                                   const double scale) {
+    if (!is_circular(cmd.shape)) return 0;
+    const double r = std::max(cmd.x1, circle_radius_y(cmd)) * scale;
+    const double n = std::ceil(2 * std::numbers::pi * r / circle_step);
+    return static_cast<std::size_t>(
+        std::clamp(n, 8.0, static_cast<double>(max_vertices)));
+}
+
+// cmd reduced to vertices, a circle to circle_vertices(cmd, scale) of them
+inline Geometry reduce(const DrawCommand& cmd, const double scale) {
+    constexpr int unit{1 << subpixel_bits};
+    Geometry g;
+    g.mode = cmd.mode;
+    auto vertex = [&g](const int x, const int y) {
+        g.vertices[g.size++] = {x * unit, y * unit};
+    };
+    switch (cmd.shape) {
+        case Shape::SQUARE:
+            // the box outline, whatever the mode
+            g.outline = Outline::POLYGON;
+            g.mode = PolygonMode::OUTLINE;
+            vertex(std::min(cmd.x0, cmd.x1), std::min(cmd.y0, cmd.y1));
+            vertex(std::max(cmd.x0, cmd.x1), std::min(cmd.y0, cmd.y1));
+            vertex(std::max(cmd.x0, cmd.x1), std::max(cmd.y0, cmd.y1));
+            vertex(std::min(cmd.x0, cmd.x1), std::max(cmd.y0, cmd.y1));
+            break;
+        case Shape::TRIANGLE:
+        case Shape::TRAPEZIUM:
+        case Shape::POLYGON:
+        case Shape::RHOMBUS:
+        case Shape::KITE: {
+            std::array<Point, max_polygon_sides> corners;
+            const auto n = shape_vertices(cmd, corners);
+            g.outline = Outline::POLYGON;
+            for (std::size_t i{0}; i < n; i++) {
+                vertex(corners[i].x, corners[i].y);
+            }
+            break;
+        }
+        case Shape::CIRCLE:
+        case Shape::CIRCLE_V2: {
+            const int ry = circle_radius_y(cmd);
+            if (cmd.x1 <= 0 || ry <= 0) {
+                g.outline = Outline::POINT;
+                vertex(cmd.x0, cmd.y0);
+                break;
+            }
+            // clockwise from the top, like shape_vertices()
+            const auto n = circle_vertices(cmd, scale);
+            g.outline = Outline::POLYGON;
+            for (std::size_t k{0}; k < n; k++) {
+                const double angle =
+                    -std::numbers::pi / 2 + 2 * std::numbers::pi * k / n;
+                g.vertices[g.size++] = {
+                    static_cast<int>(std::lround(
+                        (cmd.x0 + cmd.x1 * std::cos(angle)) * unit)),
+                    static_cast<int>(
+                        std::lround((cmd.y0 + ry * std::sin(angle)) * unit))};
+            }
+            break;
+        }
+        case Shape::LINE:
+            g.outline = Outline::LINE;
+            vertex(cmd.x0, cmd.y0);
+            vertex(cmd.x1, cmd.y1);
+            break;
+        case Shape::POINT:
+            g.outline = Outline::POINT;
+            vertex(cmd.x0, cmd.y0);
+            break;
+    }
+    return g;
+}
+
+// cmd placed by m as a command of its own shape, when m keeps the shape's
+// rasterizer: moved by whole pixels, a round circle rotated or scaled
+// uniformly, or any circle scaled along the axes
+inline std::optional<DrawCommand> direct(const DrawCommand& cmd,
+                                         const Affine& m) {
+    DrawCommand placed = cmd;
+    if (m.is_integer_translation()) {
+        const int dx = static_cast<int>(m.tx);
+        const int dy = static_cast<int>(m.ty);
+        placed.x0 += dx;
+        placed.y0 += dy;
+        if (!is_circular(cmd.shape) && cmd.shape != Shape::POINT) {
+            placed.x1 += dx;
+            placed.y1 += dy;
+        }
+        return placed;
+    }
+    if (!is_circular(cmd.shape)) return std::nullopt;
+    const Point centre = m.apply({cmd.x0, cmd.y0});
+    placed.x0 = centre.x;
+    placed.y0 = centre.y;
+    const bool round = cmd.y1 <= 0 || cmd.y1 == cmd.x1;
+    if (round && m.is_similarity()) {
+        const auto r = std::lround(m.max_scale() * std::max(cmd.x1, 0));
+        if (r > 1 << 30) return std::nullopt;
+        placed.x1 = static_cast<int>(r);
+        placed.y1 = 0;
+        return placed;
+    }
+    if (!m.is_axis_aligned()) return std::nullopt;
+    const auto rx = std::lround(std::abs(m.xx) * cmd.x1);
+    const auto ry = std::lround(std::abs(m.yy) * circle_radius_y(cmd));
+    // an ellipse needs both radii, and rasterize_ellipse keeps to 16383
+    if (rx < 1 || ry < 1 || rx > 16383 || ry > 16383) return std::nullopt;
+    placed.x1 = static_cast<int>(rx);
+    placed.y1 = static_cast<int>(ry);
+    return placed;
+}
+
+// Smallest rectangle holding the vertices of cmd placed by m. Every vertex
+// lies in the command's box and the placed ones in its image, rounding
+// included, so the box's four corners are enough.
+inline Rect placed_bounds(const DrawCommand& cmd,
+                          const canvas_kernels::FixedAffine& m) {
+    const Rect box = bounds(cmd);
+    constexpr int unit{1 << subpixel_bits};
+    const std::array<Point, 4> corners{
+        Point{box.x0 * unit, box.y0 * unit},
+        Point{(box.x1 - 1) * unit, box.y0 * unit},
+        Point{(box.x1 - 1) * unit, (box.y1 - 1) * unit},
+        Point{box.x0 * unit, (box.y1 - 1) * unit}};
+    std::array<Point, 4> placed;
+    transform_points(placed, corners, m);
+    return polygon_bounds(placed);
+}
+
+// Draws g placed by m, which takes subpixel_bits input bits, inside area
+template <PixelSurface Surface>
+void draw(Surface& cv, const Geometry& g, const canvas_kernels::FixedAffine& m,
+          const pixel_of<Surface> colour, const Rect& area) {
+    std::array<Point, max_vertices> placed;
+    transform_points(placed, g.view(), m);
+    switch (g.outline) {
+        case Outline::POLYGON:
+            rasterize_polygon(cv, std::span<const Point>(placed.data(), g.size),
+                              colour, g.mode, area);
+            break;
+        case Outline::LINE:
+            rasterize_line(cv, placed[0], placed[1], colour, area);
+            break;
+        case Outline::POINT:
+            if (!area.contains(placed[0].x, placed[0].y)) break;
+            cv.at(placed[0].x, placed[0].y) = colour;
+            mark_written(cv, {placed[0].x, placed[0].y, placed[0].x + 1,
+                              placed[0].y + 1});
+            break;
+        case Outline::NONE:
+            break;
+    }
+}
+
+// Coverage counterpart of draw()
+inline void draw_coverage(Canvas8& alpha, const Geometry& g,
+                          const canvas_kernels::FixedAffine& m,
+                          const coverage::Samples samples, const Rect& area) {
+    std::array<Point, max_vertices> placed;
+    transform_points(placed, g.view(), m);
+    switch (g.outline) {
+        case Outline::POLYGON:
+            coverage::polygon(alpha,
+                              std::span<const Point>(placed.data(), g.size),
+                              g.mode, samples, area);
+            break;
+        case Outline::LINE:
+            coverage::line(alpha, placed[0], placed[1], area);
+            break;
+        case Outline::POINT:
+            if (!area.contains(placed[0].x, placed[0].y)) break;
+            coverage::plot(alpha, placed[0].x, placed[0].y, 255);
+            mark_written(alpha, {placed[0].x, placed[0].y, placed[0].x + 1,
+                                 placed[0].y + 1});
+            break;
+        case Outline::NONE:
+            break;
+    }
+}
+
+}  // namespace affine
+
+// Area cmd can touch once placed by m
+inline Rect bounds(const DrawCommand& cmd, const Affine& m) {
+    if (const auto placed = affine::direct(cmd, m)) return bounds(*placed);
+    return affine::placed_bounds(cmd, m.fixed(affine::subpixel_bits));
+}
+
+// Rasterizes cmd placed by m into the part of the canvas inside clip
+template <PixelSurface Surface>
+void rasterize(Surface& cv, const DrawCommand& cmd, const Affine& m,
+               const Rect& clip) {
+    if (const auto placed = affine::direct(cmd, m)) {
+        rasterize(cv, *placed, clip);
+        return;
+    }
+    const auto fixed = m.fixed(affine::subpixel_bits);
+    const Rect area = clip.intersect(canvas_rect(cv))
+                          .intersect(affine::placed_bounds(cmd, fixed));
+    if (area.empty()) return;
+    affine::draw(cv, affine::reduce(cmd, m.max_scale()), fixed,
+                 static_cast<pixel_of<Surface>>(cmd.colour), area);
+}
+
+template <PixelSurface Surface>
+void rasterize(Surface& cv, const DrawCommand& cmd, const Affine& m) {
+    rasterize(cv, cmd, m, canvas_rect(cv));
+}
+
+// Draws cmd once at every placement, the same pixels as calling
+// rasterize(cv, cmd, m, clip) for each. The command is reduced to vertices
+// once, only again for a circle whose scale needs a different number of
+// outline points, so each further instance costs one batch transform.
+template <PixelSurface Surface>
+void rasterize_instances(Surface& cv, const DrawCommand& cmd,
+                         std::span<const Affine> placements,
+                         const Rect& clip) {
+    const Rect visible = clip.intersect(canvas_rect(cv));
+    if (visible.empty()) return;
+    const auto colour = static_cast<pixel_of<Surface>>(cmd.colour);
+    std::optional<affine::Geometry> geometry;
+    std::size_t circle_points{0};
+    for (const Affine& m : placements) {
+        if (const auto placed = affine::direct(cmd, m)) {
+            rasterize(cv, *placed, visible);
+            continue;
+        }
+        const auto fixed = m.fixed(affine::subpixel_bits);
+        const Rect area =
+            visible.intersect(affine::placed_bounds(cmd, fixed));
+        if (area.empty()) continue;
+        const double scale = m.max_scale();
+        const auto points = affine::circle_vertices(cmd, scale);
+        if (!geometry || points != circle_points) {
+            geometry = affine::reduce(cmd, scale);
+            circle_points = points;
+        }
+        affine::draw(cv, *geometry, fixed, colour, area);
+    }
+}
+
+template <PixelSurface Surface>
+void rasterize_instances(Surface& cv, const DrawCommand& cmd,
+                         std::span<const Affine> placements) {
+    rasterize_instances(cv, cmd, placements, canvas_rect(cv));
+}
+
+// Coverage counterpart of rasterize(cv, cmd, m, clip)
+inline void rasterize_coverage(
+    Canvas8& alpha, const DrawCommand& cmd, const Affine& m, const Rect& clip,
+    const coverage::Samples samples = coverage::Samples::X4) {
+    if (const auto placed = affine::direct(cmd, m)) {
+        rasterize_coverage(alpha, *placed, clip, samples);
+        return;
+    }
+    const auto fixed = m.fixed(affine::subpixel_bits);
+    const Rect area = clip.intersect(canvas_rect(alpha))
+                          .intersect(affine::placed_bounds(cmd, fixed));
+    if (area.empty()) return;
+    affine::draw_coverage(alpha, affine::reduce(cmd, m.max_scale()), fixed,
+                          samples, area);
+}
+
+#endif  // AFFINE_TRANSFORM_H
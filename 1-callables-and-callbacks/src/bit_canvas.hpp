@@ -0,0 +1,315 @@
+#ifndef BIT_CANVAS_H
+#define BIT_CANVAS_H
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "canvas.hpp"
+
+// One bit per pixel canvas for masks, where a pixel is only ever set or
+// clear. Every row is padded to whole 64 bit words, pixel x of a row being
+// bit x % 64 of word x / 64, and padding bits are always zero. Spans are
+// filled a word at a time, statistics use popcount and whole canvases
+// combine with AND / OR / XOR one word at a time.
+// The interface follows BasicCanvas, except that at() returns a proxy and
+// rows are exposed as words rather than pixels, so the shape rasterizers
+// work on it unchanged.
+template <>
+class BasicCanvas<bool> {
+   public:
+    using pixel_type = bool;
+    using word_type = std::uint64_t;
+
+    static constexpr std::size_t word_bits{64};
+    // Pixels sharing a word must be written by the same thread
+    static constexpr std::size_t column_alignment{word_bits};
+
+    // Writable reference to one bit
+    class Reference {
+       public:
+        Reference(word_type& w, const word_type m) : word{&w}, mask{m} {}
+
+        Reference& operator=(const bool val) {
+            *word = val ? *word | mask : *word & ~mask;
+            return *this;
+        }
+        operator bool() const { return (*word & mask) != 0; }
+
+       private:
+        word_type* word;
+        word_type mask;
+    };
+
+    BasicCanvas() = default;
+
+    BasicCanvas(const std::size_t w, const std::size_t h)
+        : width{w},
+          height{h},
+          stride{words_for(w)},
+          data_words(stride * h, 0),
+          dirty{w, h} {}
+
+    void display() const {
+        std::cout << "*************Canvas ID: " << this << " ************\n";
+        for (std::size_t y{0}; y < height; y++) {
+            print_row(y);
+        }
+        std::cout << "*************Canvas ID: " << this << " ************"
+                  << std::endl;
+    }
+
+    // Prints only the rows changed since the dirty state was last cleared,
+    // each prefixed with its row number, then clears it
+    void display_changes() {
+        std::cout << "*************Canvas ID: " << this << " ************\n";
+        const auto rows = dirty.rows();
+        for (std::size_t y{rows.begin}; y < rows.end; y++) {
+            if (dirty.columns(y).empty()) continue;
+            std::cout << y << ':';
+            print_row(y);
+        }
+        std::cout << "*************Canvas ID: " << this << " ************"
+                  << std::endl;
+        clear_dirty();
+    }
+
+    // 0 based index, x is the column and y is the row
+    bool set_coord(const std::size_t x, const std::size_t y, const bool val) {
+        if (!is_within_bounds(x, y)) return false;
+        at(x, y) = val;
+        dirty.mark(y, x, x + 1);
+        return true;
+    }
+
+    std::optional<bool> get_coord(const std::size_t x,
+                                  const std::size_t y) const {
+        if (!is_within_bounds(x, y)) return std::nullopt;
+        return at(x, y);
+    }
+
+    // Unchecked access for callers that have already clipped to the canvas,
+    // untracked like BasicCanvas::at()
+    Reference at(const std::size_t x, const std::size_t y) {
+        return {data_words[y * stride + x / word_bits], bit(x)};
+    }
+    bool at(const std::size_t x, const std::size_t y) const {
+        return (data_words[y * stride + x / word_bits] & bit(x)) != 0;
+    }
+
+    // Fills the half open range [x_begin, x_end) of row y, whole words at a
+    // time between the two partial end words
+    void fill_row_segment(const std::size_t y, const std::size_t x_begin,
+                          std::size_t x_end, const bool val) {
+        if (y >= height) return;
+        x_end = std::min(x_end, width);
+        if (x_begin >= x_end) return;
+        word_type* line = data_words.data() + y * stride;
+        const std::size_t first = x_begin / word_bits;
+        const std::size_t last = (x_end - 1) / word_bits;
+        const word_type head = head_mask(x_begin);
+        const word_type tail = tail_mask(x_end);
+        if (first == last) {
+            apply(line[first], head & tail, val);
+        } else {
+            apply(line[first], head, val);
+            std::fill(line + first + 1, line + last,
+                      val ? ~word_type{0} : word_type{0});
+            apply(line[last], tail, val);
+        }
+        dirty.mark(y, x_begin, x_end);
+    }
+
+    // Fills a w x h rectangle with its top left corner at (x, y)
+    void fill_rect(const std::size_t x, const std::size_t y,
+                   const std::size_t w, const std::size_t h, const bool val) {
+        if (x >= width || y >= height) return;
+        const std::size_t x_end = x + std::min(w, width - x);
+        const std::size_t y_end = y + std::min(h, height - y);
+        for (std::size_t j{y}; j < y_end; j++) {
+            fill_row_segment(j, x, x_end, val);
+        }
+    }
+
+    void fill(const bool val) {
+        for (std::size_t y{0}; y < height; y++) {
+            fill_row_segment(y, 0, width, val);
+        }
+    }
+
+    std::size_t get_width() const { return width; }
+    std::size_t get_height() const { return height; }
+
+    // Words per row
+    std::size_t get_stride() const { return stride; }
+
+    // Row y as words. Padding bits past the width must stay zero. Handing
+    // out a writable row marks the whole row dirty.
+    std::span<word_type> row_words(const std::size_t y) {
+        dirty.mark(y, 0, width);
+        return {data_words.data() + y * stride, stride};
+    }
+    std::span<const word_type> row_words(const std::size_t y) const {
+        return {data_words.data() + y * stride, stride};
+    }
+
+    // Whole buffer, rows back to back
+    std::span<word_type> words() {
+        dirty.mark_all();
+        return data_words;
+    }
+    std::span<const word_type> words() const { return data_words; }
+
+    // Number of set pixels
+    std::size_t count() const {
+        std::size_t n{0};
+        for (const word_type w : data_words) n += std::popcount(w);
+        return n;
+    }
+
+    // Number of set pixels in the half open range [x_begin, x_end) of row y
+    std::size_t count_row_segment(const std::size_t y,
+                                  const std::size_t x_begin,
+                                  std::size_t x_end) const {
+        if (y >= height) return 0;
+        x_end = std::min(x_end, width);
+        if (x_begin >= x_end) return 0;
+        const word_type* line = data_words.data() + y * stride;
+        const std::size_t first = x_begin / word_bits;
+        const std::size_t last = (x_end - 1) / word_bits;
+        const word_type head = head_mask(x_begin);
+        const word_type tail = tail_mask(x_end);
+        if (first == last) return std::popcount(line[first] & head & tail);
+        std::size_t n = std::popcount(line[first] & head);
+        for (std::size_t i{first + 1}; i < last; i++) {
+            n += std::popcount(line[i]);
+        }
+        return n + std::popcount(line[last] & tail);
+    }
+
+    // Pixelwise combination with a canvas of the same size, other sizes
+    // leave this canvas unchanged
+    BasicCanvas& operator&=(const BasicCanvas& other) {
+        return combine(other, [](word_type a, word_type b) { return a & b; });
+    }
+    BasicCanvas& operator|=(const BasicCanvas& other) {
+        return combine(other, [](word_type a, word_type b) { return a | b; });
+    }
+    BasicCanvas& operator^=(const BasicCanvas& other) {
+        return combine(other, [](word_type a, word_type b) { return a ^ b; });
+    }
+
+    // Flips every pixel
+    void invert() {
+        if (stride == 0) return;
+        for (std::size_t y{0}; y < height; y++) {
+            word_type* line = data_words.data() + y * stride;
+            for (std::size_t i{0}; i < stride; i++) line[i] = ~line[i];
+            line[stride - 1] &= last_word_mask();
+        }
+        dirty.mark_all();
+    }
+
+    // Dirty tracking, as for BasicCanvas
+    using DirtySpan = DirtyTracker::Span;
+
+    DirtySpan dirty_columns(const std::size_t y) const {
+        return dirty.columns(y);
+    }
+    DirtySpan dirty_row_range() const { return dirty.rows(); }
+    bool is_dirty() const { return dirty.any(); }
+    void set_dirty_tracking(const bool on) { dirty.set_tracking(on); }
+    bool is_dirty_tracking() const { return dirty.is_tracking(); }
+    void mark_dirty(const std::size_t y, const std::size_t x_begin,
+                    const std::size_t x_end) {
+        dirty.mark(y, x_begin, x_end);
+    }
+    void mark_dirty_rows(const std::size_t y_begin, const std::size_t y_end,
+                         const std::size_t x_begin, const std::size_t x_end) {
+        dirty.mark_rows(y_begin, y_end, x_begin, x_end);
+    }
+    void mark_all_dirty() { dirty.mark_all(); }
+    void clear_dirty() { dirty.clear(); }
+
+   private:
+    // Dimensions
+    std::size_t width{16}, height{16};
+    std::size_t stride{words_for(width)};
+    std::vector<word_type> data_words =
+        std::vector<word_type>(stride * height);
+    DirtyTracker dirty{width, height};
+
+    static constexpr std::size_t words_for(const std::size_t w) {
+        return (w + word_bits - 1) / word_bits;
+    }
+    static constexpr word_type bit(const std::size_t x) {
+        return word_type{1} << (x % word_bits);
+    }
+    // Bits of the first and last word of [x_begin, x_end) inside the range
+    static constexpr word_type head_mask(const std::size_t x_begin) {
+        return ~word_type{0} << (x_begin % word_bits);
+    }
+    static constexpr word_type tail_mask(const std::size_t x_end) {
+        return ~word_type{0} >> (word_bits - 1 - (x_end - 1) % word_bits);
+    }
+    static void apply(word_type& w, const word_type mask, const bool val) {
+        w = val ? w | mask : w & ~mask;
+    }
+
+    // Bits of the last word in a row that hold pixels
+    word_type last_word_mask() const {
+        const std::size_t used = width % word_bits;
+        return used == 0 ? ~word_type{0} : (word_type{1} << used) - 1;
+    }
+
+    bool is_within_bounds(const std::size_t x, const std::size_t y) const {
+        return x < width && y < height;
+    }
+
+    template <typename Op>
+    BasicCanvas& combine(const BasicCanvas& other, Op op) {
+        if (other.width != width || other.height != height) return *this;
+        for (std::size_t i{0}; i < data_words.size(); i++) {
+            data_words[i] = op(data_words[i], other.data_words[i]);
+        }
+        dirty.mark_all();
+        return *this;
+    }
+
+    void print_row(const std::size_t y) const {
+        for (std::size_t x{0}; x < width; x++) {
+            std::cout << (at(x, y) ? " * " : " . ");
+        }
+        std::cout << '\n';
+    }
+};
+
+using Canvas1 = BasicCanvas<bool>;
+
+// Mask of the non zero pixels of cv, built 64 pixels to a word
+template <typename Pixel>
+Canvas1 to_mask(const BasicCanvas<Pixel>& cv) {
+    Canvas1 mask(cv.get_width(), cv.get_height());
+    for (std::size_t y{0}; y < cv.get_height(); y++) {
+        const auto pixels = cv.row(y);
+        auto out = mask.row_words(y);
+        for (std::size_t i{0}; i < out.size(); i++) {
+            const std::size_t x0 = i * Canvas1::word_bits;
+            const std::size_t n =
+                std::min(Canvas1::word_bits, pixels.size() - x0);
+            Canvas1::word_type w{0};
+            for (std::size_t b{0}; b < n; b++) {
+                w |= Canvas1::word_type{pixels[x0 + b] != Pixel{}} << b;
+            }
+            out[i] = w;
+        }
+    }
+    return mask;
+}
+
+#endif  // BIT_CANVAS_H
@@ -0,0 +1,435 @@
+#ifndef CANVAS_H
+#define CANVAS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+// Which pixels of a canvas changed since the last clear(): per row, the
+// half open range of columns that may have been written, plus the range of
+// rows holding any. A clean span is {width, 0} (or {height, 0}) so marking
+// is a plain min / max. Starts fully dirty.
+class DirtyTracker {
+   public:
+    struct Span {
+        std::size_t begin{0}, end{0};  // half open columns or rows
+
+        bool empty() const { return begin >= end; }
+    };
+
+    DirtyTracker() = default;
+    DirtyTracker(const std::size_t w, const std::size_t h)
+        : width{w}, height{h}, spans(h, Span{0, w}), row_range{0, h} {}
+
+    Span columns(const std::size_t y) const {
+        return y < height ? spans[y] : Span{};
+    }
+    Span rows() const { return row_range; }
+    bool any() const { return !row_range.empty(); }
+
+    void set_tracking(const bool on) { tracking = on; }
+    bool is_tracking() const { return tracking; }
+
+    void mark(const std::size_t y, const std::size_t x_begin,
+              const std::size_t x_end) {
+        if (!tracking || y >= height || x_begin >= x_end) return;
+        auto& d = spans[y];
+        d.begin = std::min(d.begin, x_begin);
+        d.end = std::max(d.end, std::min(x_end, width));
+        row_range.begin = std::min(row_range.begin, y);
+        row_range.end = std::max(row_range.end, y + 1);
+    }
+    // Columns [x_begin, x_end) of every row in [y_begin, y_end)
+    void mark_rows(const std::size_t y_begin, std::size_t y_end,
+                   const std::size_t x_begin, std::size_t x_end) {
+        y_end = std::min(y_end, height);
+        x_end = std::min(x_end, width);
+        if (!tracking || y_begin >= y_end || x_begin >= x_end) return;
+        for (std::size_t y{y_begin}; y < y_end; y++) {
+            auto& d = spans[y];
+            d.begin = std::min(d.begin, x_begin);
+            d.end = std::max(d.end, x_end);
+        }
+        row_range.begin = std::min(row_range.begin, y_begin);
+        row_range.end = std::max(row_range.end, y_end);
+    }
+    void mark_all() {
+        if (!tracking) return;
+        std::fill(spans.begin(), spans.end(), Span{0, width});
+        row_range = {0, height};
+    }
+    void clear() {
+        for (std::size_t y{row_range.begin}; y < row_range.end; y++) {
+            spans[y] = {width, 0};
+        }
+        row_range = {height, 0};
+    }
+
+   private:
+    std::size_t width{0}, height{0};
+    std::vector<Span> spans;
+    Span row_range;
+    bool tracking{true};
+};
+
+// A 2D grid of pixels stored as a single contiguous row-major buffer.
+// Pixel (x, y) lives at index y * width + x, so a row is one contiguous
+// span and walking rows in order walks memory in order.
+// The buffer is normally owned by the canvas, but a canvas can also draw
+// into memory owned by someone else (a mapped file, a pooled buffer).
+// Copies always own their pixels.
+template <typename Pixel = int>
+class BasicCanvas {
+   public:
+    using pixel_type = Pixel;
+
+    // Columns that share storage and must be written by the same thread
+    static constexpr std::size_t column_alignment{1};
+
+    BasicCanvas() = default;
+
+    BasicCanvas(const std::size_t w, const std::size_t h)
+        : width{w},
+          height{h},
+          data_points(w * h, Pixel{}),
+          base{data_points.data()},
+          dirty{w, h} {}
+
+    // Draws into caller owned storage of at least w * h pixels, which must
+    // outlive the canvas. The pixels are used as they are.
+    BasicCanvas(std::span<Pixel> storage, const std::size_t w,
+                const std::size_t h)
+        : width{w},
+          height{h},
+          data_points{},
+          base{storage.data()},
+          dirty{w, h} {}
+
+    BasicCanvas(const BasicCanvas& other)
+        : width{other.width},
+          height{other.height},
+          data_points(other.base, other.base + other.width * other.height),
+          base{data_points.data()},
+          dirty{other.dirty} {}
+
+    BasicCanvas(BasicCanvas&& other) noexcept
+        : width{other.width},
+          height{other.height},
+          data_points(std::move(other.data_points)),
+          base{other.base},
+          dirty{std::move(other.dirty)} {
+        other.forget();
+    }
+
+    BasicCanvas& operator=(const BasicCanvas& other) {
+        if (this != &other) *this = BasicCanvas(other);
+        return *this;
+    }
+
+    BasicCanvas& operator=(BasicCanvas&& other) noexcept {
+        if (this == &other) return *this;
+        width = other.width;
+        height = other.height;
+        data_points = std::move(other.data_points);
+        base = other.base;
+        dirty = std::move(other.dirty);
+        other.forget();
+        return *this;
+    }
+
+    ~BasicCanvas() = default;
+
+    // False when drawing into storage owned by someone else
+    bool owns_storage() const { return base == data_points.data(); }
+
+    // Changes the size in place, keeping the top left block both sizes
+    // share and setting new pixels to fill. Owned storage is only
+    // reallocated when the new size exceeds capacity(). Storage owned by
+    // someone else cannot grow beyond its pixel count, false is returned
+    // then and the canvas left unchanged. The whole canvas becomes dirty.
+    // Resampling the picture to a new size is canvas_kernels::resample.
+    bool resize(const std::size_t w, const std::size_t h,
+                const Pixel fill = Pixel{}) {
+        const std::size_t n = w * h;
+        const std::size_t old_n = width * height;
+        const bool owned = owns_storage();
+        if (n > capacity() && !owned) return false;
+        if (n > old_n) {
+            data_points.resize(n);
+            base = data_points.data();
+        }
+        const std::size_t keep_w = std::min(w, width);
+        const std::size_t keep_h = std::min(h, height);
+        if (w <= width) {
+            // Narrower rows move towards the front, top row first
+            for (std::size_t y{1}; y < keep_h; y++) {
+                const Pixel* from = base + y * width;
+                std::copy(from, from + keep_w, base + y * w);
+            }
+        } else {
+            // Wider rows move towards the back, bottom row first
+            for (std::size_t y{keep_h}; y-- > 0;) {
+                const Pixel* from = base + y * width;
+                if (y > 0)
+                    std::copy_backward(from, from + keep_w,
+                                       base + y * w + keep_w);
+                std::fill(base + y * w + keep_w, base + (y + 1) * w, fill);
+            }
+        }
+        std::fill(base + keep_h * w, base + n, fill);
+        // Shrinking a vector keeps its capacity
+        if (owned && n < old_n) data_points.resize(n);
+        width = w;
+        height = h;
+        const bool tracking = dirty.is_tracking();
+        dirty = DirtyTracker{w, h};
+        dirty.set_tracking(tracking);
+        return true;
+    }
+
+    // Pixels the storage holds without reallocating
+    std::size_t capacity() const {
+        return owns_storage() ? data_points.capacity() : width * height;
+    }
+
+    // Makes room for pixels in owned storage ahead of resize()
+    void reserve(const std::size_t pixels) {
+        if (!owns_storage()) return;
+        data_points.reserve(pixels);
+        base = data_points.data();
+    }
+
+    void display() const {
+        std::cout << "*************Canvas ID: " << this << " ************\n";
+        for (std::size_t y{0}; y < height; y++) {
+            print_row(y);
+        }
+        std::cout << "*************Canvas ID: " << this << " ************"
+                  << std::endl;
+    }
+
+    // Prints only the rows changed since the dirty state was last cleared,
+    // each prefixed with its row number, then clears it
+    void display_changes() {
+        std::cout << "*************Canvas ID: " << this << " ************\n";
+        const auto rows = dirty.rows();
+        for (std::size_t y{rows.begin}; y < rows.end; y++) {
+            if (dirty.columns(y).empty()) continue;
+            std::cout << y << ':';
+            print_row(y);
+        }
+        std::cout << "*************Canvas ID: " << this << " ************"
+                  << std::endl;
+        clear_dirty();
+    }
+
+    // 0 based index, x is the column and y is the row
+    bool set_coord(const std::size_t x, const std::size_t y,
+                   const Pixel val) {  // returns true if set is successful
+        if (!is_within_bounds(x, y)) return false;
+        base[y * width + x] = val;
+        mark_dirty(y, x, x + 1);
+        return true;
+    }
+
+    std::optional<Pixel> get_coord(const std::size_t x,
+                                   const std::size_t y) const {
+        // bounds check
+        if (!is_within_bounds(x, y)) return std::nullopt;
+        return base[y * width + x];
+    }
+
+    // Unchecked access for callers that have already clipped to the canvas.
+    // Writes through it are not tracked, the caller marks what it wrote.
+    Pixel& at(const std::size_t x, const std::size_t y) {
+        return base[y * width + x];
+    }
+    const Pixel& at(const std::size_t x, const std::size_t y) const {
+        return base[y * width + x];
+    }
+
+    // Bulk writers, clipped once up front instead of per pixel
+    // Fills the half open range [x_begin, x_end) of row y
+    void fill_row_segment(const std::size_t y, std::size_t x_begin,
+                          std::size_t x_end, const Pixel val) {
+        if (y >= height) return;
+        x_end = std::min(x_end, width);
+        if (x_begin >= x_end) return;
+        auto* line = base + y * width;
+        std::fill(line + x_begin, line + x_end, val);
+        mark_dirty(y, x_begin, x_end);
+    }
+
+    // Fills a w x h rectangle with its top left corner at (x, y)
+    void fill_rect(const std::size_t x, const std::size_t y,
+                   const std::size_t w, const std::size_t h,
+                   const Pixel val) {
+        if (x >= width || y >= height) return;
+        const std::size_t x_end = x + std::min(w, width - x);
+        const std::size_t y_end = y + std::min(h, height - y);
+        for (std::size_t j{y}; j < y_end; j++) {
+            fill_row_segment(j, x, x_end, val);
+        }
+    }
+
+    void fill(const Pixel val) {
+        std::fill(base, base + width * height, val);
+        mark_all_dirty();
+    }
+
+    // Copies src onto this canvas with its top left pixel at (x, y),
+    // clipped to this canvas. x and y may be negative.
+    void blit(const BasicCanvas& src, const std::ptrdiff_t x,
+              const std::ptrdiff_t y) {
+        blit(src, 0, 0, src.width, src.height, x, y);
+    }
+
+    // Copies the w x h block of src whose top left pixel is (src_x, src_y)
+    // so that pixel lands on (x, y). src may be this canvas, overlapping
+    // blocks are copied as if through a temporary.
+    void blit(const BasicCanvas& src, std::size_t src_x, std::size_t src_y,
+              std::size_t w, std::size_t h, std::ptrdiff_t x,
+              std::ptrdiff_t y) {
+        if (src_x >= src.width || src_y >= src.height) return;
+        w = std::min(w, src.width - src_x);
+        h = std::min(h, src.height - src_y);
+        // Negative offsets clip the block's left and top
+        if (x < 0) {
+            const auto skip = static_cast<std::size_t>(-x);
+            if (skip >= w) return;
+            src_x += skip;
+            w -= skip;
+            x = 0;
+        }
+        if (y < 0) {
+            const auto skip = static_cast<std::size_t>(-y);
+            if (skip >= h) return;
+            src_y += skip;
+            h -= skip;
+            y = 0;
+        }
+        const auto dst_x = static_cast<std::size_t>(x);
+        const auto dst_y = static_cast<std::size_t>(y);
+        if (dst_x >= width || dst_y >= height) return;
+        w = std::min(w, width - dst_x);
+        h = std::min(h, height - dst_y);
+        // Moving a block down within one canvas goes bottom up, so rows
+        // are read before they are overwritten
+        const bool bottom_up = &src == this && dst_y > src_y;
+        for (std::size_t j{0}; j < h; j++) {
+            const std::size_t r = bottom_up ? h - 1 - j : j;
+            const Pixel* from = src.base + (src_y + r) * src.width + src_x;
+            Pixel* to = base + (dst_y + r) * width + dst_x;
+            if (to <= from)
+                std::copy(from, from + w, to);
+            else
+                std::copy_backward(from, from + w, to + w);
+            mark_dirty(dst_y + r, dst_x, dst_x + w);
+        }
+    }
+
+    std::size_t get_width() const { return width; }
+    std::size_t get_height() const { return height; }
+
+    // Row accessors, y must be less than the height. Handing out a writable
+    // row marks the whole row dirty.
+    std::span<Pixel> row(const std::size_t y) {
+        mark_dirty(y, 0, width);
+        return {base + y * width, width};
+    }
+    std::span<const Pixel> row(const std::size_t y) const {
+        return {base + y * width, width};
+    }
+
+    // Columns [x_begin, x_end) of row y, which must lie inside the canvas.
+    // The writable one marks only those columns dirty.
+    std::span<Pixel> row(const std::size_t y, const std::size_t x_begin,
+                         const std::size_t x_end) {
+        mark_dirty(y, x_begin, x_end);
+        return {base + y * width + x_begin, x_end - x_begin};
+    }
+    std::span<const Pixel> row(const std::size_t y, const std::size_t x_begin,
+                               const std::size_t x_end) const {
+        return {base + y * width + x_begin, x_end - x_begin};
+    }
+
+    // Whole buffer, rows back to back. The writable one marks every row.
+    std::span<Pixel> pixels() {
+        mark_all_dirty();
+        return {base, width * height};
+    }
+    std::span<const Pixel> pixels() const { return {base, width * height}; }
+
+    // Dirty tracking. Every writer records, per row, the columns it may
+    // have changed since the last clear_dirty(), so a preview can re-emit
+    // only what changed. A new canvas starts fully dirty.
+    using DirtySpan = DirtyTracker::Span;
+
+    // Columns of row y changed since the last clear, empty if none
+    DirtySpan dirty_columns(const std::size_t y) const {
+        return dirty.columns(y);
+    }
+    // Rows between the first and last changed row, some may be clean
+    DirtySpan dirty_row_range() const { return dirty.rows(); }
+    bool is_dirty() const { return dirty.any(); }
+
+    // While paused, writers do not record anything. Used by parallel
+    // writers that share rows and mark their region up front instead.
+    void set_dirty_tracking(const bool on) { dirty.set_tracking(on); }
+    bool is_dirty_tracking() const { return dirty.is_tracking(); }
+
+    void mark_dirty(const std::size_t y, const std::size_t x_begin,
+                    const std::size_t x_end) {
+        dirty.mark(y, x_begin, x_end);
+    }
+    void mark_dirty_rows(const std::size_t y_begin, const std::size_t y_end,
+                         const std::size_t x_begin, const std::size_t x_end) {
+        dirty.mark_rows(y_begin, y_end, x_begin, x_end);
+    }
+    void mark_all_dirty() { dirty.mark_all(); }
+    void clear_dirty() { dirty.clear(); }
+
+   private:
+    // Dimensions
+    std::size_t width{16}, height{16};
+    std::vector<Pixel> data_points = std::vector<Pixel>(width * height);
+    Pixel* base{data_points.data()};  // first pixel, owned or not
+
+    DirtyTracker dirty{width, height};
+
+    // bounds check
+    bool is_within_bounds(const std::size_t x, const std::size_t y) const {
+        return x < width && y < height;
+    }
+
+    // Leaves a moved from canvas empty rather than pointing at pixels it
+    // gave away
+    void forget() {
+        width = 0;
+        height = 0;
+        data_points = std::vector<Pixel>{};
+        base = nullptr;
+        dirty = DirtyTracker{};
+    }
+
+    void print_row(const std::size_t y) const {
+        for (const auto& point : row(y)) {
+            if (point == Pixel{})
+                std::cout << " . ";
+            else
+                std::cout << " * ";
+        }
+        std::cout << '\n';
+    }
+};
+
+using Canvas = BasicCanvas<int>;
+using Canvas8 = BasicCanvas<std::uint8_t>;
+using Canvas32 = BasicCanvas<std::uint32_t>;
+
+#endif  // CANVAS_H
@@ -0,0 +1,224 @@
+/*
+ * Benchmarks for the canvas drawing engine: canvas construction, each
+ * Shape rasterizer through myDrawer, both through the runtime Shape
+ * dispatch and as paint<S>() (listed as NAME<>), canvas_mask_painter and
+ * display().
+ *
+ *   canvas_bench [max_side] [min_seconds]
+ *
+ * Every case runs on square canvases of 16, 1024, 4096 and 16384 pixels a
+ * side (those up to max_side, 16384 by default) and is repeated until it
+ * has taken min_seconds (0.2 by default). For each repetition it reports
+ *   ns/pixel       time over the canvas's pixel count
+ *   allocs, bytes  operator new calls and the bytes they asked for
+ *   touched        pixel bytes the case wrote, counted as the pixels one
+ *                  run changes on a cleared canvas, plus canvas bytes read
+ *                  and text written by the cases that read every pixel
+ * A 16384 x 16384 canvas takes 1 GiB, two exist while it is constructed.
+ */
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <streambuf>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "canvas.hpp"
+#include "canvas_drawer.hpp"
+#include "shape_raster.hpp"
+
+namespace {
+
+std::atomic<std::size_t> allocation_count{0};
+std::atomic<std::size_t> allocated_bytes{0};
+
+// Counts the characters written to it and drops them, so display() is
+// measured without a terminal
+class CountingBuffer : public std::streambuf {
+   public:
+    std::size_t count{0};
+
+   protected:
+    int_type overflow(const int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) count++;
+        return traits_type::not_eof(c);
+    }
+    std::streamsize xsputn(const char*, const std::streamsize n) override {
+        count += static_cast<std::size_t>(n);
+        return n;
+    }
+};
+
+// Keeps results alive so the optimiser cannot drop the work
+volatile int sink{0};
+
+struct Result {
+    std::size_t reps{0};
+    double seconds{0};
+    std::size_t allocs{0};
+    std::size_t bytes{0};
+};
+
+// Runs op until min_seconds have passed, at least once
+template <typename Op>
+Result measure(Op&& op, const double min_seconds) {
+    using Clock = std::chrono::steady_clock;
+    Result r;
+    const std::size_t allocs0 = allocation_count.load();
+    const std::size_t bytes0 = allocated_bytes.load();
+    const auto start = Clock::now();
+    do {
+        op();
+        r.reps++;
+        r.seconds =
+            std::chrono::duration<double>(Clock::now() - start).count();
+    } while (r.seconds < min_seconds);
+    r.allocs = allocation_count.load() - allocs0;
+    r.bytes = allocated_bytes.load() - bytes0;
+    return r;
+}
+
+// Pixel bytes draw() writes, as the pixels it changes on a cleared canvas.
+// The drawer's ink is not zero, so every written pixel changes; one
+// written twice counts once. Only the dirty spans are searched, they hold
+// every write.
+template <typename Draw>
+std::size_t written_bytes(Canvas& cv, Draw&& draw) {
+    cv.fill(Canvas::pixel_type{});
+    cv.clear_dirty();
+    draw();
+    const Canvas& drawn = cv;
+    const auto rows = drawn.dirty_row_range();
+    std::size_t n{0};
+    for (std::size_t y{rows.begin}; y < rows.end; y++) {
+        const auto span = drawn.dirty_columns(y);
+        if (span.empty()) continue;
+        for (const auto p : drawn.row(y).subspan(span.begin,
+                                                 span.end - span.begin)) {
+            if (p != Canvas::pixel_type{}) n++;
+        }
+    }
+    return n * sizeof(Canvas::pixel_type);
+}
+
+void report(const std::string& name, const std::size_t side, const Result& r,
+            const std::size_t touched) {
+    const double pixels = static_cast<double>(side) * static_cast<double>(side);
+    const double reps = static_cast<double>(r.reps);
+    std::printf("%-16s %6zu %8zu %12.4f %8.1f %14.0f %14zu\n", name.c_str(),
+                side, r.reps, r.seconds * 1e9 / reps / pixels,
+                static_cast<double>(r.allocs) / reps,
+                static_cast<double>(r.bytes) / reps, touched);
+}
+
+struct NamedShape {
+    Shape shape;
+    const char* name;
+};
+
+constexpr NamedShape shapes[]{
+    {Shape::SQUARE, "SQUARE"},       {Shape::TRIANGLE, "TRIANGLE"},
+    {Shape::CIRCLE, "CIRCLE"},       {Shape::TRAPEZIUM, "TRAPEZIUM"},
+    {Shape::POLYGON, "POLYGON"},     {Shape::RHOMBUS, "RHOMBUS"},
+    {Shape::KITE, "KITE"},           {Shape::LINE, "LINE"},
+    {Shape::POINT, "POINT"},         {Shape::CIRCLE_V2, "CIRCLE_V2"}};
+
+void bench_size(const std::size_t side, const double min_seconds) {
+    constexpr std::size_t pixel_size{sizeof(Canvas::pixel_type)};
+    const std::size_t canvas_bytes{side * side * pixel_size};
+
+    {
+        const Result r = measure(
+            [side] {
+                const Canvas cv(side, side);
+                sink = sink + cv.at(side - 1, side - 1);
+            },
+            min_seconds);
+        report("construct", side, r, canvas_bytes);
+    }
+
+    myDrawer drawer(std::make_shared<Canvas>(side, side));
+    drawer.set_auto_display(false);
+    Canvas& cv = drawer.canvas();
+
+    for (const auto& [shape, name] : shapes) {
+        const std::size_t touched =
+            written_bytes(cv, [&drawer, shape] { drawer.paint(shape); });
+        const Result r = measure(
+            [&drawer, shape] { sink = sink + drawer.paint(shape).at(0, 0); },
+            min_seconds);
+        report(name, side, r, touched);
+    }
+
+    // The same shapes dispatched at compile time
+    [&]<std::size_t... I>(std::index_sequence<I...>) {
+        (
+            [&] {
+                constexpr Shape shape{shapes[I].shape};
+                const std::size_t touched =
+                    written_bytes(cv, [&drawer] { drawer.paint<shape>(); });
+                const Result r = measure(
+                    [&drawer] {
+                        sink = sink + drawer.paint<shape>().at(0, 0);
+                    },
+                    min_seconds);
+                report(std::string{shapes[I].name} + "<>", side, r, touched);
+            }(),
+            ...);
+    }(std::make_index_sequence<std::size(shapes)>{});
+
+    // Draws, then reads and writes every pixel to scale it
+    const std::size_t painted =
+        written_bytes(cv, [&drawer] { drawer.paint(Shape::CIRCLE); }) +
+        2 * canvas_bytes;
+    const Result painter = measure(
+        [&drawer] { canvas_mask_painter(drawer, Shape::CIRCLE, 42); },
+        min_seconds);
+    report("mask_painter", side, painter, painted);
+
+    // display() reads every pixel and writes its text to std::cout
+    CountingBuffer text;
+    std::streambuf* const terminal = std::cout.rdbuf(&text);
+    const Result shown = measure([&cv] { cv.display(); }, min_seconds);
+    std::cout.rdbuf(terminal);
+    report("display", side, shown, canvas_bytes + text.count / shown.reps);
+}
+
+}  // namespace
+
+// Every allocation goes through these, the array and sized forms included.
+// Kept out of line, GCC otherwise sees free() on operator new's pointer.
+[[gnu::noinline]] void* operator new(const std::size_t n) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(n, std::memory_order_relaxed);
+    if (void* p = std::malloc(n == 0 ? 1 : n)) return p;
+    throw std::bad_alloc{};
+}
+[[gnu::noinline]] void operator delete(void* p) noexcept { std::free(p); }
+[[gnu::noinline]] void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+int main(int argc, char* argv[]) {
+    const std::size_t max_side =
+        argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 16384;
+    const double min_seconds = argc > 2 ? std::strtod(argv[2], nullptr) : 0.2;
+
+    std::printf("%-16s %6s %8s %12s %8s %14s %14s\n", "case", "side", "reps",
+                "ns/pixel", "allocs", "alloc bytes", "touched");
+    constexpr std::size_t sides[]{16, 1024, 4096, 16384};
+    for (const std::size_t side : sides) {
+        if (side > max_side) break;
+        try {
+            bench_size(side, min_seconds);
+        } catch (const std::bad_alloc&) {
+            std::printf("%zu x %zu: out of memory, skipped\n", side, side);
+        }
+    }
+}
@@ -0,0 +1,142 @@
+#ifndef CANVAS_COMPOSE_H
+#define CANVAS_COMPOSE_H
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <type_traits>
+
+#include "canvas.hpp"
+#include "canvas_kernels.hpp"
+#include "geometry.hpp"
+
+// How compose() combines a source pixel s with the destination pixel d
+//   COPY          d = s
+//   ADD_SATURATE  d = d + s, clamped to the pixel type's range
+//   MAX           d = max(d, s)
+//   OVER          d = s blended over d by the layer opacity, where s is
+//                 not Pixel{} (the background is transparent)
+//   XOR           d = d ^ s, bitwise
+enum class ComposeOp : std::uint8_t {
+    COPY = 0x01,
+    ADD_SATURATE = 0x02,
+    MAX = 0x03,
+    OVER = 0x04,
+    XOR = 0x05
+};
+
+namespace canvas_kernels {
+
+// Combines n pixels of src into dst. 8 and 32 bit pixels take the vector
+// row kernels, other pixel types a plain loop.
+template <typename Pixel>
+void compose_row(std::span<Pixel> dst, std::span<const Pixel> src,
+                 const ComposeOp op, const std::uint8_t opacity = 255) {
+    constexpr bool u8 = std::same_as<Pixel, std::uint8_t>;
+    constexpr bool i32 = std::same_as<Pixel, std::int32_t>;
+    switch (op) {
+        case ComposeOp::COPY:
+            std::copy(src.begin(), src.begin() + dst.size(), dst.begin());
+            break;
+        case ComposeOp::ADD_SATURATE:
+            if constexpr (u8 || i32) {
+                add_saturate(dst, src);
+            } else {
+                for (std::size_t i{0}; i < dst.size(); i++) {
+                    if constexpr (std::is_integral_v<Pixel>) {
+                        constexpr Pixel hi = std::numeric_limits<Pixel>::max();
+                        constexpr Pixel lo = std::numeric_limits<Pixel>::min();
+                        if (src[i] > 0 && dst[i] > hi - src[i]) {
+                            dst[i] = hi;
+                        } else if (std::is_signed_v<Pixel> && src[i] < 0 &&
+                                   dst[i] < lo - src[i]) {
+                            dst[i] = lo;
+                        } else {
+                            dst[i] = static_cast<Pixel>(dst[i] + src[i]);
+                        }
+                    } else {
+                        dst[i] = dst[i] + src[i];
+                    }
+                }
+            }
+            break;
+        case ComposeOp::MAX:
+            if constexpr (u8 || i32) {
+                maximum(dst, src);
+            } else {
+                for (std::size_t i{0}; i < dst.size(); i++) {
+                    dst[i] = std::max(dst[i], src[i]);
+                }
+            }
+            break;
+        case ComposeOp::OVER:
+            if constexpr (u8 || i32) {
+                over(dst, src, opacity);
+            } else {
+                for (std::size_t i{0}; i < dst.size(); i++) {
+                    if (src[i] == Pixel{}) continue;
+                    dst[i] = opacity == 255
+                                 ? src[i]
+                                 : detail::blend_wide(dst[i], opacity, src[i]);
+                }
+            }
+            break;
+        case ComposeOp::XOR:
+            bitwise_xor(std::as_writable_bytes(dst),
+                        std::as_bytes(src.first(dst.size())));
+            break;
+    }
+}
+
+// Combines the from block of src into dst with the block's top left pixel
+// landing on at, clipped to both canvases. at may be negative. opacity
+// only applies to OVER. Only the written columns are marked dirty.
+template <typename Pixel>
+void compose(const BasicCanvas<Pixel>& src, const Rect& from,
+             BasicCanvas<Pixel>& dst, const Point at, const ComposeOp op,
+             const std::uint8_t opacity = 255) {
+    const Rect area = from.intersect(canvas_rect(src));
+    if (area.empty()) return;
+    // Translation from src to dst coordinates
+    const int dx = at.x - from.x0;
+    const int dy = at.y - from.y0;
+    if (op == ComposeOp::COPY) {
+        dst.blit(src, area.x0, area.y0, area.x1 - area.x0, area.y1 - area.y0,
+                 area.x0 + dx, area.y0 + dy);
+        return;
+    }
+    if (&src == &dst) {
+        // The row kernels read and write in one pass, so an overlapping
+        // source is read from a copy
+        const BasicCanvas<Pixel> copy{src};
+        compose(copy, from, dst, at, op, opacity);
+        return;
+    }
+    const Rect target = Rect{area.x0 + dx, area.y0 + dy, area.x1 + dx,
+                             area.y1 + dy}
+                            .intersect(canvas_rect(dst));
+    if (target.empty()) return;
+    const auto x_begin = static_cast<std::size_t>(target.x0);
+    const auto x_end = static_cast<std::size_t>(target.x1);
+    const auto src_begin = static_cast<std::size_t>(target.x0 - dx);
+    const auto src_end = static_cast<std::size_t>(target.x1 - dx);
+    for (int y{target.y0}; y < target.y1; y++) {
+        compose_row(dst.row(y, x_begin, x_end),
+                    src.row(y - dy, src_begin, src_end), op, opacity);
+    }
+}
+
+// Combines all of src into dst with src's top left pixel at at
+template <typename Pixel>
+void compose(const BasicCanvas<Pixel>& src, BasicCanvas<Pixel>& dst,
+             const ComposeOp op, const Point at = {},
+             const std::uint8_t opacity = 255) {
+    compose(src, canvas_rect(src), dst, at, op, opacity);
+}
+
+}  // namespace canvas_kernels
+
+#endif  // CANVAS_COMPOSE_H
@@ -4,11 +4,33 @@
 #include <cmath>
 #include <concepts>
 #include <cstdint>
+#include <filesystem>
 #include <iostream>
 #include <memory>
+#include <numbers>
 #include <optional>
+#include <sstream>
 #include <vector>
 
+#include "affine_transform.hpp"
+#include "bit_canvas.hpp"
+#include "canvas.hpp"
+#include "canvas_compose.hpp"
+#include "canvas_drawer.hpp"
+#include "canvas_encoder.hpp"
+#include "canvas_kernels.hpp"
+#include "canvas_pool.hpp"
+#include "canvas_regions.hpp"
+#include "canvas_resample.hpp"
+#include "canvas_snapshot.hpp"
+#include "coverage_raster.hpp"
+#include "draw_list.hpp"
+#include "mapped_canvas.hpp"
+#include "rgba_canvas.hpp"
+#include "shape_raster.hpp"
+#include "sparse_canvas.hpp"
+#include "work_stealing_pool.hpp"
+
 struct Droid {
     static Droid clone() { return Droid{}; }
 };
@@ -22,263 +44,6 @@ concept Clonable = requires(C clonable) {
     // requires std::same_as<C, decltype(clonable.clone())>;
 };
 
-class Canvas {
-   public:
-    Canvas() = default;
-
-    Canvas(const std::size_t w, const std::size_t h) : width{w}, height{h} {
-        data_points =
-            std::vector<std::vector<int>>(height, std::vector<int>(width, 0));
-    }
-
-    // other functions
-    // void resize (){}
-    // void scale (){}
-    void display() {
-        std::cout << "*************Canvas ID: " << this << " ************\n";
-        for (const auto& line : data_points) {
-            for (const auto& point : line) {
-                if (point == 0)
-                    std::cout << " . ";
-                else
-                    std::cout << " * ";
-            }
-            std::cout << '\n';
-        }
-        std::cout << "*************Canvas ID: " << this << " ************"
-                  << std::endl;
-    }
-    // 0 based index
-    bool set_coord(const std::size_t x, const std::size_t y,
-                   const int val) {  // returns true if set is successful
-        if (!is_within_bounds(x, y)) return false;
-        data_points[x][y] = val;
-        return true;
-    }
-
-    std::optional<int> get_coord(const std::size_t x,
-                                 const std::size_t y) const {
-        // bounds check
-        if (!is_within_bounds(x, y)) return std::nullopt;
-        return data_points[y][x];
-    }
-
-    std::size_t get_width() const { return width; }
-    std::size_t get_height() const { return height; }
-
-   private:
-    // Dimensions
-    std::size_t width{16}, height{16};
-    std::vector<std::vector<int>> data_points =
-        std::vector<std::vector<int>>(height, std::vector<int>(width, 0));
-
-    // bounds check
-    bool is_within_bounds(const std::size_t x, const std::size_t y) const {
-        if ((x > width - 1) | (y > height - 1) | x < 0 | y < 0) return false;
-        return true;
-    }
-};
-
-enum class Shape : std::uint8_t {
-    SQUARE = 0x01,
-    TRIANGLE = 0x02,
-    CIRCLE = 0x03,
-    TRAPEZIUM = 0x04,
-    POLYGON = 0x05,
-    RHOMBUS = 0x06,
-    KITE = 0x07,
-    LINE = 0x08,
-    POINT = 0x09,
-    CIRCLE_V2 = 0x10
-};
-
-template <typename C>
-concept CanvasDrawer = requires(C canvasDrawer, Canvas cv, Shape shape) {
-    canvasDrawer.setCanvas(&cv);
-    { canvasDrawer.getCanvas() } -> std::same_as<std::shared_ptr<Canvas>>;
-    { canvasDrawer.draw() } -> std::same_as<std::shared_ptr<Canvas>>;
-    { canvasDrawer(shape) } -> std::same_as<std::shared_ptr<Canvas>>;
-    //{ canvasDrawer.transferCanvas() } ->
-    // std::same_as<std::shared_ptr<Canvas>>;  //can be set as a requirement
-};
-
-// class myDrawer;
-
-class myDrawer {
-   public:
-    explicit myDrawer(std::shared_ptr<Canvas> cv) : sheet{std::move(cv)} {}
-    std::shared_ptr<Canvas> draw() {
-        sheet->display();
-        std::cout << "displayed Canvas through Drawer\n\n";
-        return sheet;
-    }
-
-    // overloaded call operator
-    std::shared_ptr<Canvas> operator()(Shape sp) {
-        std::cout << "Drawing on Canvas:\n";
-        std::size_t canvas_width{sheet->get_width()},
-            canvas_height{sheet->get_height()};
-        // Type Checks
-        switch (sp) {
-            case Shape::SQUARE:
-                // Draw a square on the extreme dimensions of canvas
-                // Calculate the coordinates for all the extreme points
-                // draw along the top and bottom widths
-                for (std::size_t i{0}; i < canvas_width; i++) {
-                    sheet->set_coord(0, i, 1);
-                    sheet->set_coord(canvas_height - 1, i, 1);
-                }
-                // draw along the left and right height
-                for (std::size_t i{0}; i < canvas_height; i++) {
-                    sheet->set_coord(i, 0, 1);
-                    sheet->set_coord(i, canvas_width - 1, 1);
-                }
-                break;
-            // NOLINTBEGIN
-            case Shape::TRIANGLE:
-                // Centre a triangle within the canvas
-                // Add your code here
-                break;
-            case Shape::CIRCLE:
-                // Circle inscribed within a canvas
-                {
-                    // Center of the canvas
-                    int mid_x = canvas_width / 2;
-                    int mid_y = canvas_height / 2;
-                    int radius = std::min(mid_x, mid_y);
-                    int diameter = 2 * radius;
-
-                    for (int i = 0; i <= diameter; ++i) {
-                        for (int j = 0; j <= diameter; ++j) {
-                            // Calculate the distance from the center
-                            int distance = std::round(
-                                std::sqrt((i - radius) * (i - radius) +
-                                          (j - radius) * (j - radius)));
-
-                            if (distance == radius - 1) {
-                                sheet->set_coord(i, j, 1);
-                            }
-                        }
-                    }
-                    break;
-                }
-            case Shape::TRAPEZIUM:
-                // Centre a trapezium within the canvas
-                // Add your code here
-                break;
-            case Shape::POLYGON:
-                // Centre a polygon within the canvas
-                // Add your code here
-                break;
-            case Shape::RHOMBUS:
-                // Centre a rhombus within the canvas
-                // Add your code here
-                break;
-            case Shape::KITE:
-                // Centre a kite within the canvas
-                // Add your code here
-                break;
-            case Shape::LINE:
-                // Centre a line within the canvas
-                // Add your code here
-                break;
-            // NOLINTEND
-            case Shape::POINT:
-                // Centre a point within the canvas
-                sheet->set_coord(canvas_width / 2, canvas_height / 2, 1);
-
-            case Shape::CIRCLE_V2:
-                // Alternate algo for a circle inscribed in a canvas
-                {
-                    // Center of the canvas
-                    int mid_x = canvas_width / 2;
-                    int mid_y = canvas_height / 2;
-
-                    int x_cursor = std::min(mid_x, mid_y);
-                    int y_cursor = 0;
-                    int axis = 0;
-                    while (x_cursor >= y_cursor) {
-                        // programmatic approach
-                        /* bool flip = false;
-                        int sign = -1;
-                        for (int i = 0; i < 4; i++) {
-                            // flip sign every 2 iterations
-                            if ((i) % 2 == 0) sign *= -1;
-                            sheet->set_coord(mid_y + sign * y,
-                                             mid_x + std::pow(-1, i) * x, 1);
-
-                        }
-                        for (int i = 0; i < 4; i++) {
-                            if ((i) % 2 == 0) sign *= -1;
-                            sheet->set_coord(mid_x + sign * x,
-                                             mid_y + std::pow(-1, i) * y, 1);
-
-                        } */
-                        // set_coord is bounds checked
-                        sheet->set_coord(mid_y + y_cursor, mid_x + x_cursor, 1);
-                        sheet->set_coord(mid_y + y_cursor, mid_x - x_cursor, 1);
-                        sheet->set_coord(mid_y - y_cursor, mid_x + x_cursor, 1);
-                        sheet->set_coord(mid_y - y_cursor, mid_x - x_cursor, 1);
-                        sheet->set_coord(mid_y + x_cursor, mid_x + y_cursor, 1);
-                        sheet->set_coord(mid_y + x_cursor, mid_x - y_cursor, 1);
-                        sheet->set_coord(mid_y - x_cursor, mid_x + y_cursor, 1);
-                        sheet->set_coord(mid_y - x_cursor, mid_x - y_cursor, 1);
-
-                        if (axis <= 0) {
-                            y_cursor += 1;
-                            axis += 2 * y_cursor + 1;
-                        }
-
-                        if (axis > 0) {
-                            x_cursor -= 1;
-                            axis -= 2 * x_cursor + 1;
-                        }
-                    }
-                    break;
-                }
-        }
-        std::cout << "Drew on Canvas\n";
-        return draw();
-    }
-
-    // Getters and setters
-    std::shared_ptr<Canvas> getCanvas() { return sheet; }
-
-    // Required for the constraint to hold
-    // 0 is error
-    bool setCanvas(Canvas* cv) {
-        if (cv != nullptr)
-            sheet.reset(cv);
-        else
-            return false;
-        return true;
-    }
-
-    std::shared_ptr<Canvas> transferCanvas() { return std::move(sheet); }
-
-   private:
-    // Data members
-    std::shared_ptr<Canvas> sheet;
-};
-
-// A Higher order function accepting CanvasDrawer callable
-// For Higher order functions it is always a good idea to provide a default
-// callable in case it is not provided
-void canvas_mask_painter(
-    CanvasDrawer auto cdraw = myDrawer(std::make_shared<Canvas>()),
-    Shape shape = Shape::SQUARE, int colour = 1) {
-    // draw first
-    cdraw(shape);
-
-    // Scale to colour
-    for (std::size_t i{0}; i < cdraw.getCanvas()->get_width(); i++) {
-        for (std::size_t j{0}; j < cdraw.getCanvas()->get_height(); j++) {
-            cdraw.getCanvas()->set_coord(
-                i, j, cdraw.getCanvas()->get_coord(i, j).value_or(0) * colour);
-        }
-    }
-}
-
 int main() {
     // Testing clonable concept
     Clonable auto c = Droid{};
@@ -289,15 +54,16 @@ int main() {
     Canvas rectangular_canvas(8, 4);
     rectangular_canvas.display();
 
+    // Canvases for the demo come from a pool, a dropped canvas gives its
+    // buffer back for the next one of a similar size
+    CanvasPool<int> canvases;
+
     // Canvas to draw on throughout demo
     std::cout << "New Canvas size 17 X 17\n";
-    Canvas cv(17, 17);
+    std::shared_ptr<Canvas> canvasPtr = canvases.acquire(17, 17);
+    Canvas& cv = *canvasPtr;
     cv.display();
 
-    // shared pointer with custom empty deleter (because object is on stack)
-    std::shared_ptr<Canvas> canvasPtr(
-        &cv, [](Canvas*) { std::cout << "Tried to delete\n\n"; });
-
     // Passed canvas to Drawer
     myDrawer draw_for_me(canvasPtr);
     // myDrawer draw_for_me(std::make_shared<Canvas>());  //temporary created
@@ -317,11 +83,207 @@ int main() {
 
     canvas_mask_painter(draw_for_me, Shape::CIRCLE, 42);
 
+    // Deferred mode, shapes are recorded and drawn together by flush()
+    std::cout << "Batched drawing on a new 33 X 33 canvas\n";
+    myDrawer batch_drawer(canvases.acquire(33, 33));
+    batch_drawer.set_deferred(true);
+    batch_drawer(Shape::SQUARE);
+    batch_drawer(Shape::CIRCLE_V2);
+    batch_drawer.commands().push({Shape::CIRCLE_V2, 1, 16, 16, 6});
+    batch_drawer.commands().push({Shape::POINT, 1, 16, 16});
+    batch_drawer.commands().push(
+        {Shape::TRIANGLE, 1, 12, 19, 20, 25, PolygonMode::FILLED});
+    batch_drawer.commands().push({Shape::LINE, 1, 3, 29, 29, 21});
+    batch_drawer.flush();
+    batch_drawer.draw();
+
+    // Same scene rendered in 8 X 8 tiles across a thread pool
+    std::cout << "Tiled drawing on a thread pool\n";
+    WorkStealingPool pool;
+    myDrawer tiled_drawer(canvases.acquire(33, 33));
+    tiled_drawer.set_deferred(true);
+    tiled_drawer.set_tile_pool(&pool, 8);
+    tiled_drawer(Shape::SQUARE);
+    tiled_drawer(Shape::CIRCLE_V2);
+    tiled_drawer.commands().push({Shape::CIRCLE_V2, 1, 16, 16, 6});
+    tiled_drawer.commands().push({Shape::POINT, 1, 16, 16});
+    tiled_drawer.flush();
+    tiled_drawer.draw();
+
+    // Draw quietly, then encode the canvas once and write it in one call
+    std::cout << "Quiet drawing, encoded output\n";
+    myDrawer quiet_drawer(std::make_shared<Canvas>(17, 17));
+    quiet_drawer.set_auto_display(false);
+    quiet_drawer(Shape::SQUARE);
+    quiet_drawer(Shape::CIRCLE_V2);
+    CanvasEncoder encoder;
+    encoder.encode(*quiet_drawer.getCanvas(), CanvasEncoder::Format::ASCII);
+    encoder.write(std::cout);
+    std::cout << "PGM size in bytes: "
+              << encoder
+                     .encode(*quiet_drawer.getCanvas(),
+                             CanvasEncoder::Format::PGM)
+                     .size()
+              << '\n';
+
+    // A lossless snapshot, then only what the next frame changed, read
+    // back by a second pipeline stage
+    std::stringstream stage;
+    SnapshotEncoder snapshots;
+    snapshots.write(quiet_drawer.canvas(), stage);
+    std::cout << "Snapshot size in bytes: " << snapshots.size();
+    Canvas next_frame = quiet_drawer.canvas();
+    rasterize(next_frame, DrawCommand{Shape::POINT, 1, 8, 8});
+    snapshots.write_delta(next_frame, quiet_drawer.canvas(), stage);
+    std::cout << ", delta: " << snapshots.size() << '\n';
+    Canvas received;
+    SnapshotDecoder snapshot_reader;
+    const bool frames_read = snapshot_reader.read(stage, received) &&
+                             snapshot_reader.read(stage, received);
+    std::cout << "Snapshots read back: " << std::boolalpha << frames_read
+              << ", centre pixel: " << received.at(8, 8) << std::noboolalpha
+              << '\n';
+
+    // The same drawing as a one bit mask, compared with a circle mask
+    Canvas1 mask = to_mask(*quiet_drawer.getCanvas());
+    const std::size_t mask_pixels = mask.count();
+    Canvas1 ring(17, 17);
+    rasterize(ring, DrawCommand{Shape::CIRCLE_V2, 1, 8, 8, 8});
+    mask ^= ring;
+    std::cout << "Mask pixels set: " << mask_pixels
+              << ", differing from the circle: " << mask.count() << '\n';
+
+    // A huge surface only allocates the chunks a shape touches
+    SparseCanvas<int> surface(100000, 100000);
+    rasterize(surface, DrawCommand{Shape::CIRCLE, 1, 50000, 50000, 2000});
+    canvas_kernels::scale(surface, 42);
+    std::cout << "Sparse canvas chunks: " << surface.chunk_count()
+              << ", encoded bytes: "
+              << encoder.encode_chunks(surface, CanvasEncoder::Format::PGM)
+                     .size()
+              << '\n';
+
+    // Drawing straight into a file, then reading it back through a second
+    // read only mapping as another process would
+    const auto canvas_file =
+        (std::filesystem::temp_directory_path() / "canvas_drawer.canvas")
+            .string();
+    if (auto file = MappedCanvas<int>::create(canvas_file.c_str(), 17, 17)) {
+        myDrawer file_drawer(file->canvas());
+        file_drawer.set_auto_display(false);
+        file_drawer(Shape::RHOMBUS);
+        file->sync();
+        const auto reader = MappedCanvas<int>::open(
+            canvas_file.c_str(), MappedCanvas<int>::Mode::READ_ONLY);
+        if (reader) {
+            std::cout << "Canvas read back from " << canvas_file << '\n';
+            reader->const_canvas()->display();
+        }
+    }
+    std::filesystem::remove(canvas_file);
+
+    // After a point only its row is sent again
+    std::cout << "Incremental redisplay\n";
+    quiet_drawer.getCanvas()->clear_dirty();
+    quiet_drawer(Shape::POINT);
+    quiet_drawer.draw_changes();
+
+    // Anti-aliased coverage, blended onto an 8 bit canvas in one pass
+    std::cout << "Anti-aliased drawing, composited\n";
+    DrawList smooth;
+    smooth.push({Shape::CIRCLE, 1, 16, 16, 12});
+    smooth.push({Shape::LINE, 1, 2, 30, 30, 4});
+    Canvas8 alpha(33, 33);
+    smooth.rasterize_coverage(alpha, coverage::Samples::X4);
+    Canvas8 grey(33, 33);
+    canvas_kernels::composite(grey, alpha, std::uint8_t{200});
+    std::cout << "PGM size in bytes: "
+              << encoder.encode(grey, CanvasEncoder::Format::PGM).size()
+              << '\n';
+
+    // A frame built from layers: a copy of the background, a filled
+    // triangle laid over it and a circle XORed on top
+    std::cout << "Layers composed into one frame\n";
+    Canvas layered(17, 17);
+    Canvas sprite(9, 9);
+    rasterize(sprite, DrawCommand{Shape::TRIANGLE, 1, 0, 0, 8, 8,
+                                  PolygonMode::FILLED});
+    Canvas halo(9, 9);
+    rasterize(halo, DrawCommand{Shape::CIRCLE_V2, 1, 4, 4, 4});
+    canvas_kernels::compose(*batch_drawer.getCanvas(), layered, ComposeOp::COPY,
+                            {-8, -8});
+    canvas_kernels::compose(sprite, layered, ComposeOp::OVER, {4, 4});
+    canvas_kernels::compose(halo, layered, ComposeOp::XOR, {8, 0});
+    layered.display();
+
+    // A preview at half the size, each pixel the average of the area it
+    // covers
+    std::cout << "Frame scaled down to 9 X 9\n";
+    canvas_kernels::scaled(layered, 9, 9, ResampleFilter::BOX).display();
+
+    // The frame's separate shapes, then its outside painted over from a
+    // corner on the pool
+    const Components parts = label_components(layered, Connectivity::EIGHT);
+    std::cout << "Regions in the frame: " << parts.count << '\n';
+    const std::size_t outside =
+        flood_fill_tiled(layered, {0, 0}, 7, pool, Connectivity::FOUR, 8);
+    std::cout << "Background pixels filled: " << outside << '\n';
+    layered.display();
+
+    // Small glyphs stamped from span tables traced at compile time
+    std::cout << "Sprites stamped along a row\n";
+    using Diamonds = ShapeSprites<Shape::RHOMBUS, PolygonMode::FILLED, 2, 3>;
+    Canvas glyphs(21, 7);
+    Diamonds::stamp(glyphs, {3, 3}, 3, 1);
+    Diamonds::stamp(glyphs, {10, 3}, 2, 1);
+    Diamonds::stamp(glyphs, {17, 3}, 3, 1);
+    glyphs.display();
+
+    // Colour shapes on a planar RGBA canvas, the alpha channel masked by a
+    // coverage canvas, then converted to the interleaved export layout
+    std::cout << "RGBA drawing, planar then interleaved\n";
+    PlanarRgbaDrawer colour_drawer(std::make_shared<PlanarRgbaCanvas>(16, 9));
+    colour_drawer.set_auto_display(false);
+    colour_drawer.set_colour(Rgba8{200, 40, 40});
+    colour_drawer.paint(Shape::CIRCLE);
+    colour_drawer.set_colour(Rgba8{40, 40, 200});
+    colour_drawer.paint(Shape::LINE);
+    Canvas8 fade(16, 9);
+    fade.fill_rect(0, 0, 8, 9, 255);
+    canvas_kernels::composite(colour_drawer.canvas(), RgbaChannel::ALPHA,
+                              fade, 0);
+    const RgbaCanvas exported = to_interleaved(colour_drawer.canvas());
+    exported.display();
+    const Rgba8 centre = exported.at(8, 4);
+    std::cout << "Centre pixel: " << int{centre.r} << ' ' << int{centre.g}
+              << ' ' << int{centre.b} << ' ' << int{centre.a} << '\n';
+
+    // The canvas square shrunk to half size, then placed twice, once turned
+    // 45 degrees about the centre. The drawer works out the square's
+    // corners once and only transforms them per placement.
+    std::cout << "A square placed straight and turned\n";
+    myDrawer spin_drawer(std::make_shared<Canvas>(21, 21));
+    spin_drawer.set_auto_display(false);
+    spin_drawer.set_transform(Affine::scale(0.5, 0.5, {10, 10}));
+    const std::vector<Affine> turns{
+        Affine::identity(), Affine::rotate(std::numbers::pi / 4, {10, 10})};
+    spin_drawer.paint(Shape::SQUARE, turns).display();
+
+    // One scratch canvas per frame, after the first frame the same buffer
+    // is cleared and handed out again
+    for (int frame{0}; frame < 3; frame++) {
+        myDrawer frame_drawer(canvases.acquire(33, 33));
+        frame_drawer.set_auto_display(false);
+        frame_drawer(Shape::CIRCLE);
+    }
+    std::cout << "Pool buffers allocated: " << canvases.allocations()
+              << ", cached: " << canvases.cached_buffers() << '\n';
+
     // canvasPtr = draw_for_me.transferCanvas();   //can be used to return
     // ownership
 
     // Display to test
-    std::cout << "Call display on Canvas on the stack\n";
+    std::cout << "Call display on the first Canvas\n";
     cv.display();
     std::cout << "CV display was called!!!\n";
     std::cout << "The value of a point of a line on the canvas is: "
@@ -0,0 +1,342 @@
+#ifndef CANVAS_DRAWER_H
+#define CANVAS_DRAWER_H
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <iostream>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "affine_transform.hpp"
+#include "canvas.hpp"
+#include "canvas_kernels.hpp"
+#include "draw_list.hpp"
+#include "rgba_canvas.hpp"
+#include "shape_raster.hpp"
+#include "work_stealing_pool.hpp"
+
+// The drawer interface shared by the demo and the benchmark: the
+// CanvasDrawer concepts, myDrawer which satisfies both, and the
+// canvas_mask_painter higher order function taking either. myDrawer is the
+// BasicDrawer of a Canvas, RgbaDrawer and PlanarRgbaDrawer draw in colour
+// on the two RGBA layouts.
+
+template <typename C>
+concept CanvasDrawer = requires(C canvasDrawer, Canvas cv, Shape shape) {
+    canvasDrawer.setCanvas(&cv);
+    { canvasDrawer.getCanvas() } -> std::same_as<std::shared_ptr<Canvas>>;
+    { canvasDrawer.draw() } -> std::same_as<std::shared_ptr<Canvas>>;
+    { canvasDrawer(shape) } -> std::same_as<std::shared_ptr<Canvas>>;
+    //{ canvasDrawer.transferCanvas() } ->
+    // std::same_as<std::shared_ptr<Canvas>>;  //can be set as a requirement
+};
+
+// Drawers that hand out the canvas by reference, so drawing in a loop does
+// not touch a shared_ptr reference count. paint() draws a shape like the
+// call operator of a CanvasDrawer does.
+template <typename C>
+concept FastCanvasDrawer = requires(C canvasDrawer, Shape shape) {
+    { canvasDrawer.canvas() } -> std::same_as<Canvas&>;
+    { canvasDrawer.paint(shape) } -> std::same_as<Canvas&>;
+};
+
+// Makes any CanvasDrawer usable as a FastCanvasDrawer. It holds on to the
+// canvas the drawer last returned, so canvas() is free, while each paint()
+// still goes through the drawer's shared_ptr interface.
+template <CanvasDrawer D>
+class SharedCanvasDrawer {
+   public:
+    explicit SharedCanvasDrawer(D& d) : drawer{&d}, sheet{d.getCanvas()} {}
+
+    Canvas& canvas() { return *sheet; }
+    Canvas& paint(Shape shape) {
+        sheet = (*drawer)(shape);
+        return *sheet;
+    }
+
+   private:
+    D* drawer;
+    std::shared_ptr<Canvas> sheet;
+};
+
+// class myDrawer;
+
+template <PixelSurface Surface = Canvas>
+class BasicDrawer {
+   public:
+    using pixel_type = pixel_of<Surface>;
+
+    explicit BasicDrawer(std::shared_ptr<Surface> cv) : sheet{std::move(cv)} {}
+    std::shared_ptr<Surface> draw() {
+        show();
+        return sheet;
+    }
+
+    // Shows only the rows changed since the canvas was last shown
+    std::shared_ptr<Surface> draw_changes() {
+        sheet->display_changes();
+        std::cout << "displayed Canvas changes through Drawer\n\n";
+        return sheet;
+    }
+
+    // overloaded call operator
+    // In deferred mode the shape is only recorded, flush() draws it
+    std::shared_ptr<Surface> operator()(Shape sp) {
+        paint(sp);
+        return sheet;
+    }
+
+    // Same as the call operator without copying the shared_ptr. Looks the
+    // shape up in a table of the paint<S>() instances.
+    Surface& paint(Shape sp) {
+        using Paint = Surface& (BasicDrawer::*)();
+        static constexpr auto table = make_shape_table<Paint>(
+            &BasicDrawer::paint_nothing, []<Shape S>() -> Paint {
+                return &BasicDrawer::template paint<S>;
+            });
+        return (this->*shape_entry(table, sp))();
+    }
+
+    // A shape known at compile time, e.g. paint<Shape::CIRCLE_V2>(). Its
+    // command and rasterizer are specialised and inlined.
+    template <Shape S>
+    Surface& paint() {
+        const DrawCommand cmd = centred<S>();
+        if (deferred) {
+            draw_list.push(cmd, placement);
+            return *sheet;
+        }
+        if (!auto_display) {
+            rasterize_placed<S>(cmd);
+            return *sheet;
+        }
+        std::cout << "Drawing on Canvas:\n";
+        rasterize_placed<S>(cmd);
+        std::cout << "Drew on Canvas\n";
+        show();
+        return *sheet;
+    }
+
+    // The shape once at every placement, each applied after the drawer's
+    // own transform. The shape is only reduced to vertices once.
+    Surface& paint(Shape sp, std::span<const Affine> placements) {
+        using Paint = Surface& (BasicDrawer::*)(std::span<const Affine>);
+        static constexpr auto table = make_shape_table<Paint>(
+            &BasicDrawer::paint_nothing_at, []<Shape S>() -> Paint {
+                return &BasicDrawer::template paint<S>;
+            });
+        return (this->*shape_entry(table, sp))(placements);
+    }
+
+    template <Shape S>
+    Surface& paint(std::span<const Affine> placements) {
+        const DrawCommand cmd = centred<S>();
+        instances.clear();
+        for (const Affine& m : placements) {
+            instances.push_back(m * placement);
+        }
+        if (deferred) {
+            for (const Affine& m : instances) {
+                draw_list.push(cmd, m);
+            }
+            return *sheet;
+        }
+        if (!auto_display) {
+            rasterize_instances(*sheet, cmd, instances);
+            return *sheet;
+        }
+        std::cout << "Drawing on Canvas:\n";
+        rasterize_instances(*sheet, cmd, instances);
+        std::cout << "Drew on Canvas\n";
+        show();
+        return *sheet;
+    }
+
+    // Colour the following shapes are drawn in, recorded ones included.
+    // 1 on integer canvases and opaque white on RGBA ones until set.
+    void set_colour(const pixel_type c) { ink = c; }
+    pixel_type colour() const { return ink; }
+
+    // Placement of the following shapes, recorded ones included. Shapes are
+    // centred on the canvas first, so a rotation about the canvas centre
+    // turns them in place. Circles stay midpoint circles under rotations
+    // and uniform scales.
+    void set_transform(const Affine& m) { placement = m; }
+    const Affine& transform() const { return placement; }
+
+    // When off, drawing a shape no longer displays the canvas afterwards
+    void set_auto_display(bool on) { auto_display = on; }
+    bool is_auto_display() const { return auto_display; }
+
+    // Command buffer mode
+    void set_deferred(bool on) { deferred = on; }
+    bool is_deferred() const { return deferred; }
+
+    // Recorded commands, shapes can also be pushed here directly
+    DrawList& commands() { return draw_list; }
+
+    // Tiled mode, flush() splits the canvas into tile_size squares and
+    // rasterizes them on the pool. nullptr goes back to the serial path,
+    // which surfaces other than a BasicCanvas always take.
+    void set_tile_pool(WorkStealingPool* pool,
+                       std::size_t tile_size = DrawList::default_tile_size) {
+        tile_pool = pool;
+        tile_extent = tile_size;
+    }
+
+    // Rasterizes every recorded command in one pass and clears the list
+    std::shared_ptr<Surface> flush() {
+        constexpr bool tiles = requires(DrawList& list, Surface& cv,
+                                        WorkStealingPool& pool) {
+            list.rasterize_tiled(cv, pool);
+        };
+        if constexpr (tiles) {
+            if (tile_pool != nullptr)
+                draw_list.rasterize_tiled(*sheet, *tile_pool, tile_extent);
+            else
+                draw_list.rasterize(*sheet);
+        } else {
+            draw_list.rasterize(*sheet);
+        }
+        draw_list.clear();
+        return sheet;
+    }
+
+    // Getters and setters
+    std::shared_ptr<Surface> getCanvas() { return sheet; }
+    Surface& canvas() { return *sheet; }
+
+    // Required for the constraint to hold
+    // 0 is error
+    bool setCanvas(Surface* cv) {
+        if (cv != nullptr)
+            sheet.reset(cv);
+        else
+            return false;
+        return true;
+    }
+    // Shares ownership instead, e.g. of a CanvasPool lease
+    bool setCanvas(std::shared_ptr<Surface> cv) {
+        if (cv == nullptr) return false;
+        sheet = std::move(cv);
+        return true;
+    }
+
+    std::shared_ptr<Surface> transferCanvas() { return std::move(sheet); }
+
+   private:
+    // Data members
+    std::shared_ptr<Surface> sheet;
+    pixel_type ink{default_ink()};
+    Affine placement;
+    std::vector<Affine> instances;
+    DrawList draw_list;
+    bool deferred{false};
+    bool auto_display{true};
+    WorkStealingPool* tile_pool{nullptr};
+    std::size_t tile_extent{DrawList::default_tile_size};
+
+    void show() {
+        sheet->display();
+        sheet->clear_dirty();
+        std::cout << "displayed Canvas through Drawer\n\n";
+    }
+
+    static constexpr pixel_type default_ink() {
+        if constexpr (std::same_as<pixel_type, Rgba8>)
+            return Rgba8{255, 255, 255};
+        else
+            return pixel_type{1};
+    }
+
+    // Values that name no shape draw nothing
+    Surface& paint_nothing() { return *sheet; }
+    Surface& paint_nothing_at(std::span<const Affine>) { return *sheet; }
+
+    // Without a transform the compile time rasterizer is kept
+    template <Shape S>
+    void rasterize_placed(const DrawCommand& cmd) {
+        if (placement.is_identity())
+            rasterize<S>(*sheet, cmd);
+        else
+            rasterize(*sheet, cmd, placement);
+    }
+
+    // Command for a shape centred within the canvas
+    template <Shape S>
+    DrawCommand centred() const {
+        const int canvas_width = static_cast<int>(sheet->get_width());
+        const int canvas_height = static_cast<int>(sheet->get_height());
+        // Center of the canvas
+        const int mid_x = canvas_width / 2;
+        const int mid_y = canvas_height / 2;
+        DrawCommand cmd{S};
+        cmd.colour = static_cast<std::int32_t>(ink);
+        // Type Checks
+        if constexpr (S == Shape::SQUARE) {
+            // Draw a square on the extreme dimensions of canvas
+            cmd.x1 = canvas_width - 1;
+            cmd.y1 = canvas_height - 1;
+        } else if constexpr (S == Shape::POLYGON) {
+            // Hexagon inscribed within a canvas
+            cmd.x1 = canvas_width - 1;
+            cmd.y1 = canvas_height - 1;
+            cmd.sides = 6;
+        } else if constexpr (is_polygonal(S)) {
+            // Fitted to the extreme dimensions of canvas
+            cmd.x1 = canvas_width - 1;
+            cmd.y1 = canvas_height - 1;
+        } else if constexpr (S == Shape::LINE) {
+            // Diagonal through the centre of the canvas
+            cmd.x1 = canvas_width - 1;
+            cmd.y1 = canvas_height - 1;
+        } else if constexpr (S == Shape::CIRCLE) {
+            // Circle inscribed within a canvas, clear of the edges
+            cmd.x0 = mid_x;
+            cmd.y0 = mid_y;
+            cmd.x1 = std::max(std::min(mid_x, mid_y) - 1, 0);
+        } else if constexpr (S == Shape::CIRCLE_V2) {
+            // Circle inscribed within a canvas, touching the edges
+            cmd.x0 = mid_x;
+            cmd.y0 = mid_y;
+            cmd.x1 = std::min(mid_x, mid_y);
+        } else if constexpr (S == Shape::POINT) {
+            // Centre a point within the canvas
+            cmd.x0 = mid_x;
+            cmd.y0 = mid_y;
+        }
+        return cmd;
+    }
+};
+
+using myDrawer = BasicDrawer<Canvas>;
+using RgbaDrawer = BasicDrawer<RgbaCanvas>;
+using PlanarRgbaDrawer = BasicDrawer<PlanarRgbaCanvas>;
+
+// A Higher order function accepting FastCanvasDrawer callable. Temporary
+// drawers are taken as well, neither is copied.
+void canvas_mask_painter(FastCanvasDrawer auto&& cdraw,
+                         Shape shape = Shape::SQUARE, int colour = 1) {
+    // draw first
+    Canvas& cv = cdraw.paint(shape);
+
+    // Scale to colour in one linear pass over the pixel buffer
+    canvas_kernels::scale(cv, colour);
+}
+
+// Drawers that only satisfy CanvasDrawer go through the adapter
+template <typename D>
+    requires(CanvasDrawer<std::remove_cvref_t<D>> &&
+             !FastCanvasDrawer<std::remove_cvref_t<D>>)
+void canvas_mask_painter(D&& cdraw, Shape shape = Shape::SQUARE,
+                         int colour = 1) {
+    SharedCanvasDrawer<std::remove_cvref_t<D>> fast{cdraw};
+    canvas_mask_painter(fast, shape, colour);
+}
+
+#endif  // CANVAS_DRAWER_H
@@ -0,0 +1,258 @@
+#ifndef CANVAS_ENCODER_H
+#define CANVAS_ENCODER_H
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ostream>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "canvas.hpp"
+#include "sparse_canvas.hpp"
+
+// Encodes a whole canvas into one reusable byte buffer in a single pass, so
+// it can be written out with a single call instead of one stream insertion
+// per pixel.
+//   ASCII  the same text Canvas::display() prints
+//   PGM    binary greyscale (P5), pixels clamped to 0..255
+//   PPM    binary colour (P6), pixels read as packed 0xRRGGBB
+//
+// encode_changes() emits only what changed since the canvas' dirty state
+// was last cleared, for streaming previews. Clearing is left to the caller
+// so several encodes can share one frame.
+//   ASCII  the same text Canvas::display_changes() prints
+//   PGM    "d5\n<width> <height>\n255\n" then one patch per changed row:
+//          "<y> <x> <count>\n" followed by count clamped pixel bytes
+//   PPM    as PGM with magic "d6" and three bytes per pixel
+//
+// encode_chunks() writes a SparseCanvas as the same patches, one per row of
+// every allocated chunk, so empty space costs nothing. ASCII rows are
+// prefixed with "<y> <x>:" since they no longer span the canvas.
+class CanvasEncoder {
+   public:
+    enum class Format : std::uint8_t { ASCII = 0x01, PGM = 0x02, PPM = 0x03 };
+
+    template <typename Pixel>
+    std::span<const char> encode(const BasicCanvas<Pixel>& cv,
+                                 const Format format) {
+        used = 0;
+        switch (format) {
+            case Format::ASCII:
+                encode_ascii(cv);
+                break;
+            case Format::PGM:
+                encode_pgm(cv);
+                break;
+            case Format::PPM:
+                encode_ppm(cv);
+                break;
+        }
+        return bytes();
+    }
+
+    template <typename Pixel>
+    std::span<const char> encode_changes(const BasicCanvas<Pixel>& cv,
+                                         const Format format) {
+        used = 0;
+        if (format == Format::ASCII) {
+            append_banner(&cv);
+            for_each_change(cv, [&](const std::size_t y, std::size_t,
+                                    std::size_t) {
+                append(y);
+                append(":");
+                append_ascii_row(cv, y);
+            });
+            append_banner(&cv);
+            return bytes();
+        }
+
+        const bool colour = format == Format::PPM;
+        append_header(colour ? "d6\n" : "d5\n", cv.get_width(),
+                      cv.get_height());
+        for_each_change(cv, [&](const std::size_t y, const std::size_t x,
+                                const std::size_t n) {
+            append(y);
+            append(" ");
+            append(x);
+            append(" ");
+            append(n);
+            append("\n");
+            const auto pixels = cv.row(y).subspan(x, n);
+            if (colour)
+                append_rgb(pixels);
+            else
+                append_grey(pixels);
+        });
+        return bytes();
+    }
+
+    template <typename Pixel>
+    std::span<const char> encode_chunks(const SparseCanvas<Pixel>& cv,
+                                        const Format format) {
+        used = 0;
+        const bool colour = format == Format::PPM;
+        if (format == Format::ASCII)
+            append_banner(&cv);
+        else
+            append_header(colour ? "d6\n" : "d5\n", cv.get_width(),
+                          cv.get_height());
+        cv.for_each_chunk([&](const auto& chunk) {
+            for (std::size_t y{0}; y < chunk.height; y++) {
+                const auto pixels = chunk.row(y);
+                append(chunk.y0 + y);
+                append(" ");
+                append(chunk.x0);
+                if (format == Format::ASCII) {
+                    append(":");
+                    append_ascii(pixels);
+                    continue;
+                }
+                append(" ");
+                append(pixels.size());
+                append("\n");
+                if (colour)
+                    append_rgb(pixels);
+                else
+                    append_grey(pixels);
+            }
+        });
+        if (format == Format::ASCII) append_banner(&cv);
+        return bytes();
+    }
+
+    // Result of the last encode
+    std::span<const char> bytes() const { return {buffer.data(), used}; }
+
+    // returns true if every byte was written
+    bool write(std::FILE* out) const {
+        return std::fwrite(buffer.data(), 1, used, out) == used;
+    }
+    void write(std::ostream& out) const {
+        out.write(buffer.data(), static_cast<std::streamsize>(used));
+        out.flush();
+    }
+
+   private:
+    std::vector<char> buffer;
+    std::size_t used{0};
+
+    // Grows the buffer so that n more bytes fit after the used ones
+    char* reserve(const std::size_t n) {
+        if (buffer.size() < used + n) buffer.resize(used + n);
+        return buffer.data() + used;
+    }
+
+    void append(const std::string_view text) {
+        std::memcpy(reserve(text.size()), text.data(), text.size());
+        used += text.size();
+    }
+
+    void append(const std::size_t value) {
+        char digits[24];
+        const auto result =
+            std::to_chars(digits, digits + sizeof digits, value);
+        append(std::string_view(digits, result.ptr));
+    }
+
+    void append_banner(const void* id) {
+        char address[32];
+        const int n = std::snprintf(address, sizeof address, "%p", id);
+        append("*************Canvas ID: ");
+        append(std::string_view(address, n > 0 ? n : 0));
+        append(" ************\n");
+    }
+
+    void append_header(const char* magic, const std::size_t w,
+                       const std::size_t h) {
+        append(magic);
+        append(w);
+        append(" ");
+        append(h);
+        append("\n255\n");
+    }
+
+    // Calls fn(y, x, n) for the changed columns [x, x + n) of every row
+    template <typename Pixel, typename Fn>
+    static void for_each_change(const BasicCanvas<Pixel>& cv, Fn&& fn) {
+        const auto rows = cv.dirty_row_range();
+        for (std::size_t y{rows.begin}; y < rows.end; y++) {
+            const auto span = cv.dirty_columns(y);
+            if (!span.empty()) fn(y, span.begin, span.end - span.begin);
+        }
+    }
+
+    // One line of " . " / " * " cells
+    template <typename Pixel>
+    void append_ascii(std::span<const Pixel> pixels) {
+        char* out = reserve(3 * pixels.size() + 1);
+        for (const auto& point : pixels) {
+            std::memcpy(out, point == Pixel{} ? " . " : " * ", 3);
+            out += 3;
+        }
+        *out = '\n';
+        used += 3 * pixels.size() + 1;
+    }
+
+    template <typename Pixel>
+    void append_ascii_row(const BasicCanvas<Pixel>& cv, const std::size_t y) {
+        append_ascii(cv.row(y));
+    }
+
+    template <typename Pixel>
+    void append_grey(std::span<const Pixel> pixels) {
+        auto* out = reinterpret_cast<unsigned char*>(reserve(pixels.size()));
+        if constexpr (std::is_same_v<Pixel, std::uint8_t>) {
+            std::memcpy(out, pixels.data(), pixels.size());
+        } else {
+            for (const auto& point : pixels) {
+                *out++ = static_cast<unsigned char>(
+                    std::clamp<Pixel>(point, Pixel{0}, Pixel{255}));
+            }
+        }
+        used += pixels.size();
+    }
+
+    template <typename Pixel>
+    void append_rgb(std::span<const Pixel> pixels) {
+        auto* out =
+            reinterpret_cast<unsigned char*>(reserve(3 * pixels.size()));
+        for (const auto& point : pixels) {
+            const auto rgb = static_cast<std::uint32_t>(point);
+            *out++ = static_cast<unsigned char>(rgb >> 16);
+            *out++ = static_cast<unsigned char>(rgb >> 8);
+            *out++ = static_cast<unsigned char>(rgb);
+        }
+        used += 3 * pixels.size();
+    }
+
+    template <typename Pixel>
+    void encode_ascii(const BasicCanvas<Pixel>& cv) {
+        // one allocation for the whole grid
+        reserve(cv.get_height() * (3 * cv.get_width() + 1) + 128);
+        append_banner(&cv);
+        for (std::size_t y{0}; y < cv.get_height(); y++) {
+            append_ascii_row(cv, y);
+        }
+        append_banner(&cv);
+    }
+
+    template <typename Pixel>
+    void encode_pgm(const BasicCanvas<Pixel>& cv) {
+        append_header("P5\n", cv.get_width(), cv.get_height());
+        append_grey(cv.pixels());
+    }
+
+    template <typename Pixel>
+    void encode_ppm(const BasicCanvas<Pixel>& cv) {
+        append_header("P6\n", cv.get_width(), cv.get_height());
+        append_rgb(cv.pixels());
+    }
+};
+
+#endif  // CANVAS_ENCODER_H
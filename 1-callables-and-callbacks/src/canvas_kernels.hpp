@@ -0,0 +1,1225 @@
+#ifndef CANVAS_KERNELS_H
+#define CANVAS_KERNELS_H
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <span>
+
+#include "canvas.hpp"
+
+// Whole canvas map kernels (scale, add, clamp, threshold), the 8 bit
+// coverage kernels (max, composite), the row kernels canvases are composed
+// with (add_saturate, maximum, bitwise_xor, over), the weighted row sums
+// resampling is built on (accumulate), conversion between interleaved and
+// planar RGBA8 (deinterleave_rgba, interleave_rgba), fixed point affine
+// transforms of vertex arrays (transform_points) and buffer clearing
+// (zero_fill).
+// The buffer is processed linearly, eight pixels at a time with AVX2, four
+// with SSE2 and one at a time otherwise (32 and 16 for 8 bit pixels). The
+// widest instruction set the CPU supports is picked once at runtime.
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CANVAS_KERNELS_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define CANVAS_TARGET_AVX2
+#else
+#define CANVAS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define CANVAS_KERNELS_X86 0
+#endif
+
+namespace canvas_kernels {
+
+enum class Isa : std::uint8_t { SCALAR = 0x00, SSE2 = 0x01, AVX2 = 0x02 };
+
+// A 2 x 3 affine matrix in 16.16 fixed point, mapping (x, y) to
+//   x' = (xx * x + xy * y + tx) / 65536
+//   y' = (yx * x + yy * y + ty) / 65536
+// rounded half up. Built from an Affine, see affine_transform.hpp.
+struct FixedAffine {
+    static constexpr int fraction_bits{16};
+    static constexpr std::int32_t one{1 << fraction_bits};
+
+    std::int32_t xx{one}, xy{0}, yx{0}, yy{one};
+    std::int64_t tx{0}, ty{0};
+
+    friend constexpr bool operator==(const FixedAffine&,
+                                     const FixedAffine&) = default;
+};
+
+namespace detail {
+
+using scale_fn = void (*)(std::int32_t*, std::size_t, std::int32_t);
+using add_fn = void (*)(std::int32_t*, std::size_t, std::int32_t);
+using clamp_fn = void (*)(std::int32_t*, std::size_t, std::int32_t,
+                          std::int32_t);
+using threshold_fn = void (*)(std::int32_t*, std::size_t, std::int32_t,
+                              std::int32_t, std::int32_t);
+using max_u8_fn = void (*)(std::uint8_t*, const std::uint8_t*, std::size_t);
+using composite_u8_fn = void (*)(std::uint8_t*, const std::uint8_t*,
+                                 std::size_t, std::uint8_t);
+using adds_u8_fn = void (*)(std::uint8_t*, const std::uint8_t*, std::size_t);
+using adds_i32_fn = void (*)(std::int32_t*, const std::int32_t*,
+                             std::size_t);
+using max_i32_fn = void (*)(std::int32_t*, const std::int32_t*, std::size_t);
+using xor_fn = void (*)(std::byte*, const std::byte*, std::size_t);
+using over_u8_fn = void (*)(std::uint8_t*, const std::uint8_t*, std::size_t,
+                            std::uint8_t);
+using over_i32_fn = void (*)(std::int32_t*, const std::int32_t*, std::size_t,
+                             std::uint8_t);
+using accumulate_u8_fn = void (*)(float*, const std::uint8_t*, std::size_t,
+                                  float);
+using accumulate_i32_fn = void (*)(double*, const std::int32_t*,
+                                   std::size_t, double);
+using deinterleave_fn = void (*)(const std::uint8_t*, std::uint8_t*,
+                                 std::uint8_t*, std::uint8_t*, std::uint8_t*,
+                                 std::size_t);
+using interleave_fn = void (*)(std::uint8_t*, const std::uint8_t*,
+                               const std::uint8_t*, const std::uint8_t*,
+                               const std::uint8_t*, std::size_t);
+using transform_fn = void (*)(std::int32_t*, const std::int32_t*,
+                              std::size_t, const FixedAffine&);
+
+struct KernelTable {
+    scale_fn scale;
+    add_fn add;
+    clamp_fn clamp;
+    threshold_fn threshold;
+    max_u8_fn max_u8;
+    composite_u8_fn composite_u8;
+    adds_u8_fn adds_u8;
+    adds_i32_fn adds_i32;
+    max_i32_fn max_i32;
+    xor_fn xor_bytes;
+    over_u8_fn over_u8;
+    over_i32_fn over_i32;
+    accumulate_u8_fn accumulate_u8;
+    accumulate_i32_fn accumulate_i32;
+    deinterleave_fn deinterleave;
+    interleave_fn interleave;
+    transform_fn transform;
+};
+
+// (colour * alpha + dst * (255 - alpha)) / 255 rounded to nearest. The
+// vector kernels compute the same thing in 16 bit lanes.
+inline std::uint8_t blend_u8(const std::uint8_t dst, const std::uint8_t alpha,
+                             const std::uint8_t colour) {
+    const std::uint32_t t = colour * alpha + dst * (255u - alpha) + 128u;
+    return static_cast<std::uint8_t>((t + (t >> 8)) >> 8);
+}
+
+// The same blend for pixels wider than 8 bits, in 64 bit arithmetic
+template <typename Pixel>
+Pixel blend_wide(const Pixel dst, const std::uint8_t alpha,
+                 const Pixel colour) {
+    const std::int64_t t =
+        std::int64_t{colour} * alpha + std::int64_t{dst} * (255 - alpha);
+    return static_cast<Pixel>((t + 127) / 255);
+}
+
+// Scalar kernels. Arithmetic wraps like the vector versions do.
+inline void scale_scalar(std::int32_t* px, std::size_t n, std::int32_t f) {
+    for (std::size_t i{0}; i < n; i++) {
+        px[i] = static_cast<std::int32_t>(static_cast<std::uint32_t>(px[i]) *
+                                          static_cast<std::uint32_t>(f));
+    }
+}
+
+inline void add_scalar(std::int32_t* px, std::size_t n, std::int32_t v) {
+    for (std::size_t i{0}; i < n; i++) {
+        px[i] = static_cast<std::int32_t>(static_cast<std::uint32_t>(px[i]) +
+                                          static_cast<std::uint32_t>(v));
+    }
+}
+
+inline void clamp_scalar(std::int32_t* px, std::size_t n, std::int32_t lo,
+                         std::int32_t hi) {
+    for (std::size_t i{0}; i < n; i++) {
+        px[i] = px[i] < lo ? lo : (px[i] > hi ? hi : px[i]);
+    }
+}
+
+// Pixels below level become lo, the rest become hi
+inline void threshold_scalar(std::int32_t* px, std::size_t n,
+                             std::int32_t level, std::int32_t lo,
+                             std::int32_t hi) {
+    for (std::size_t i{0}; i < n; i++) {
+        px[i] = px[i] < level ? lo : hi;
+    }
+}
+
+inline void max_u8_scalar(std::uint8_t* dst, const std::uint8_t* src,
+                          std::size_t n) {
+    for (std::size_t i{0}; i < n; i++) {
+        dst[i] = dst[i] < src[i] ? src[i] : dst[i];
+    }
+}
+
+inline void composite_u8_scalar(std::uint8_t* dst, const std::uint8_t* alpha,
+                                std::size_t n, std::uint8_t colour) {
+    for (std::size_t i{0}; i < n; i++) {
+        dst[i] = blend_u8(dst[i], alpha[i], colour);
+    }
+}
+
+inline void adds_u8_scalar(std::uint8_t* dst, const std::uint8_t* src,
+                           std::size_t n) {
+    for (std::size_t i{0}; i < n; i++) {
+        const unsigned sum = dst[i] + src[i];
+        dst[i] = static_cast<std::uint8_t>(sum > 255 ? 255 : sum);
+    }
+}
+
+inline void adds_i32_scalar(std::int32_t* dst, const std::int32_t* src,
+                            std::size_t n) {
+    constexpr std::int64_t lo = std::numeric_limits<std::int32_t>::min();
+    constexpr std::int64_t hi = std::numeric_limits<std::int32_t>::max();
+    for (std::size_t i{0}; i < n; i++) {
+        const std::int64_t sum = std::int64_t{dst[i]} + src[i];
+        dst[i] =
+            static_cast<std::int32_t>(sum < lo ? lo : (sum > hi ? hi : sum));
+    }
+}
+
+inline void max_i32_scalar(std::int32_t* dst, const std::int32_t* src,
+                           std::size_t n) {
+    for (std::size_t i{0}; i < n; i++) {
+        if (src[i] > dst[i]) dst[i] = src[i];
+    }
+}
+
+inline void xor_scalar(std::byte* dst, const std::byte* src, std::size_t n) {
+    for (std::size_t i{0}; i < n; i++) dst[i] ^= src[i];
+}
+
+// Source pixels of 0 are transparent, the others are blended over dst by
+// alpha
+inline void over_u8_scalar(std::uint8_t* dst, const std::uint8_t* src,
+                           std::size_t n, std::uint8_t alpha) {
+    for (std::size_t i{0}; i < n; i++) {
+        if (src[i] != 0) dst[i] = blend_u8(dst[i], alpha, src[i]);
+    }
+}
+
+inline void over_i32_scalar(std::int32_t* dst, const std::int32_t* src,
+                            std::size_t n, std::uint8_t alpha) {
+    for (std::size_t i{0}; i < n; i++) {
+        if (src[i] == 0) continue;
+        dst[i] = alpha == 255 ? src[i] : blend_wide(dst[i], alpha, src[i]);
+    }
+}
+
+// acc += weight * px. 8 bit pixels sum in float, 32 bit ones in double so
+// every value is exact.
+inline void accumulate_u8_scalar(float* acc, const std::uint8_t* px,
+                                 std::size_t n, float weight) {
+    for (std::size_t i{0}; i < n; i++) acc[i] += weight * px[i];
+}
+
+inline void accumulate_i32_scalar(double* acc, const std::int32_t* px,
+                                  std::size_t n, double weight) {
+    for (std::size_t i{0}; i < n; i++) acc[i] += weight * px[i];
+}
+
+// n pixels of 4 bytes, R G B A, to and from four planes of n bytes
+inline void deinterleave_scalar(const std::uint8_t* rgba, std::uint8_t* r,
+                                std::uint8_t* g, std::uint8_t* b,
+                                std::uint8_t* a, std::size_t n) {
+    for (std::size_t i{0}; i < n; i++) {
+        r[i] = rgba[4 * i];
+        g[i] = rgba[4 * i + 1];
+        b[i] = rgba[4 * i + 2];
+        a[i] = rgba[4 * i + 3];
+    }
+}
+
+inline void interleave_scalar(std::uint8_t* rgba, const std::uint8_t* r,
+                              const std::uint8_t* g, const std::uint8_t* b,
+                              const std::uint8_t* a, std::size_t n) {
+    for (std::size_t i{0}; i < n; i++) {
+        rgba[4 * i] = r[i];
+        rgba[4 * i + 1] = g[i];
+        rgba[4 * i + 2] = b[i];
+        rgba[4 * i + 3] = a[i];
+    }
+}
+
+// n points stored as x, y pairs. 64 bit products, so any coordinate and
+// coefficient is exact. dst may be src. The coefficients are copied first,
+// dst could alias m's as far as the compiler knows.
+inline void transform_scalar(std::int32_t* dst, const std::int32_t* src,
+                             std::size_t n, const FixedAffine& m) {
+    constexpr int shift{FixedAffine::fraction_bits};
+    constexpr std::int64_t half{std::int64_t{1} << (shift - 1)};
+    const std::int64_t xx{m.xx}, xy{m.xy}, yx{m.yx}, yy{m.yy};
+    const std::int64_t tx{m.tx + half}, ty{m.ty + half};
+    for (std::size_t i{0}; i < n; i++) {
+        const std::int64_t x = src[2 * i];
+        const std::int64_t y = src[2 * i + 1];
+        dst[2 * i] = static_cast<std::int32_t>((xx * x + xy * y + tx) >> shift);
+        dst[2 * i + 1] =
+            static_cast<std::int32_t>((yx * x + yy * y + ty) >> shift);
+    }
+}
+
+#if CANVAS_KERNELS_X86
+// NOLINTBEGIN(portability-simd-intrinsics)
+
+// SSE2 has no 32 bit mullo or min/max, so they are built from
+// _mm_mul_epu32 and compare + select
+inline __m128i mullo_sse2(__m128i a, __m128i b) {
+    const __m128i even = _mm_mul_epu32(a, b);
+    const __m128i odd =
+        _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// mask ? a : b
+inline __m128i select_sse2(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+inline void scale_sse2(std::int32_t* px, std::size_t n, std::int32_t f) {
+    const __m128i factor = _mm_set1_epi32(f);
+    std::size_t i{0};
+    for (; i + 4 <= n; i += 4) {
+        auto* p = reinterpret_cast<__m128i*>(px + i);
+        _mm_storeu_si128(p, mullo_sse2(_mm_loadu_si128(p), factor));
+    }
+    scale_scalar(px + i, n - i, f);
+}
+
+inline void add_sse2(std::int32_t* px, std::size_t n, std::int32_t v) {
+    const __m128i addend = _mm_set1_epi32(v);
+    std::size_t i{0};
+    for (; i + 4 <= n; i += 4) {
+        auto* p = reinterpret_cast<__m128i*>(px + i);
+        _mm_storeu_si128(p, _mm_add_epi32(_mm_loadu_si128(p), addend));
+    }
+    add_scalar(px + i, n - i, v);
+}
+
+inline void clamp_sse2(std::int32_t* px, std::size_t n, std::int32_t lo,
+                       std::int32_t hi) {
+    const __m128i low = _mm_set1_epi32(lo);
+    const __m128i high = _mm_set1_epi32(hi);
+    std::size_t i{0};
+    for (; i + 4 <= n; i += 4) {
+        auto* p = reinterpret_cast<__m128i*>(px + i);
+        __m128i v = _mm_loadu_si128(p);
+        v = select_sse2(_mm_cmplt_epi32(v, low), low, v);
+        v = select_sse2(_mm_cmpgt_epi32(v, high), high, v);
+        _mm_storeu_si128(p, v);
+    }
+    clamp_scalar(px + i, n - i, lo, hi);
+}
+
+inline void threshold_sse2(std::int32_t* px, std::size_t n,
+                           std::int32_t level, std::int32_t lo,
+                           std::int32_t hi) {
+    const __m128i lvl = _mm_set1_epi32(level);
+    const __m128i low = _mm_set1_epi32(lo);
+    const __m128i high = _mm_set1_epi32(hi);
+    std::size_t i{0};
+    for (; i + 4 <= n; i += 4) {
+        auto* p = reinterpret_cast<__m128i*>(px + i);
+        const __m128i below = _mm_cmplt_epi32(_mm_loadu_si128(p), lvl);
+        _mm_storeu_si128(p, select_sse2(below, low, high));
+    }
+    threshold_scalar(px + i, n - i, level, lo, hi);
+}
+
+inline void max_u8_sse2(std::uint8_t* dst, const std::uint8_t* src,
+                        std::size_t n) {
+    std::size_t i{0};
+    for (; i + 16 <= n; i += 16) {
+        auto* d = reinterpret_cast<__m128i*>(dst + i);
+        const auto* s = reinterpret_cast<const __m128i*>(src + i);
+        _mm_storeu_si128(d, _mm_max_epu8(_mm_loadu_si128(d),
+                                         _mm_loadu_si128(s)));
+    }
+    max_u8_scalar(dst + i, src + i, n - i);
+}
+
+// Eight blends in 16 bit lanes, see blend_u8
+inline __m128i blend_epi16_sse2(__m128i dst, __m128i alpha, __m128i colour) {
+    const __m128i inverse = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(colour, alpha),
+                              _mm_mullo_epi16(dst, inverse));
+    t = _mm_add_epi16(t, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+inline void composite_u8_sse2(std::uint8_t* dst, const std::uint8_t* alpha,
+                              std::size_t n, std::uint8_t colour) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i c = _mm_set1_epi16(colour);
+    std::size_t i{0};
+    for (; i + 16 <= n; i += 16) {
+        auto* d = reinterpret_cast<__m128i*>(dst + i);
+        const __m128i v = _mm_loadu_si128(d);
+        const __m128i a =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(alpha + i));
+        const __m128i lo = blend_epi16_sse2(_mm_unpacklo_epi8(v, zero),
+                                            _mm_unpacklo_epi8(a, zero), c);
+        const __m128i hi = blend_epi16_sse2(_mm_unpackhi_epi8(v, zero),
+                                            _mm_unpackhi_epi8(a, zero), c);
+        _mm_storeu_si128(d, _mm_packus_epi16(lo, hi));
+    }
+    composite_u8_scalar(dst + i, alpha + i, n - i, colour);
+}
+
+inline void adds_u8_sse2(std::uint8_t* dst, const std::uint8_t* src,
+                         std::size_t n) {
+    std::size_t i{0};
+    for (; i + 16 <= n; i += 16) {
+        auto* d = reinterpret_cast<__m128i*>(dst + i);
+        const auto* s = reinterpret_cast<const __m128i*>(src + i);
+        _mm_storeu_si128(d, _mm_adds_epu8(_mm_loadu_si128(d),
+                                          _mm_loadu_si128(s)));
+    }
+    adds_u8_scalar(dst + i, src + i, n - i);
+}
+
+// Wrapping add, then lanes whose sign came out wrong (both inputs differ in
+// sign from the sum) are replaced by the limit on the side of a
+inline __m128i adds_epi32_sse2(__m128i a, __m128i b) {
+    const __m128i sum = _mm_add_epi32(a, b);
+    const __m128i overflow = _mm_srai_epi32(
+        _mm_and_si128(_mm_xor_si128(a, sum), _mm_xor_si128(b, sum)), 31);
+    const __m128i limit = _mm_xor_si128(
+        _mm_srai_epi32(a, 31),
+        _mm_set1_epi32(std::numeric_limits<std::int32_t>::max()));
+    return select_sse2(overflow, limit, sum);
+}
+
+inline void adds_i32_sse2(std::int32_t* dst, const std::int32_t* src,
+                          std::size_t n) {
+    std::size_t i{0};
+    for (; i + 4 <= n; i += 4) {
+        auto* d = reinterpret_cast<__m128i*>(dst + i);
+        const auto* s = reinterpret_cast<const __m128i*>(src + i);
+        _mm_storeu_si128(d, adds_epi32_sse2(_mm_loadu_si128(d),
+                                            _mm_loadu_si128(s)));
+    }
+    adds_i32_scalar(dst + i, src + i, n - i);
+}
+
+inline void max_i32_sse2(std::int32_t* dst, const std::int32_t* src,
+                         std::size_t n) {
+    std::size_t i{0};
+    for (; i + 4 <= n; i += 4) {
+        auto* d = reinterpret_cast<__m128i*>(dst + i);
+        const __m128i a = _mm_loadu_si128(d);
+        const __m128i b =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(d, select_sse2(_mm_cmpgt_epi32(b, a), b, a));
+    }
+    max_i32_scalar(dst + i, src + i, n - i);
+}
+
+inline void xor_sse2(std::byte* dst, const std::byte* src, std::size_t n) {
+    std::size_t i{0};
+    for (; i + 16 <= n; i += 16) {
+        auto* d = reinterpret_cast<__m128i*>(dst + i);
+        const auto* s = reinterpret_cast<const __m128i*>(src + i);
+        _mm_storeu_si128(d, _mm_xor_si128(_mm_loadu_si128(d),
+                                          _mm_loadu_si128(s)));
+    }
+    xor_scalar(dst + i, src + i, n - i);
+}
+
+inline void over_u8_sse2(std::uint8_t* dst, const std::uint8_t* src,
+                         std::size_t n, std::uint8_t alpha) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i a = _mm_set1_epi16(alpha);
+    std::size_t i{0};
+    for (; i + 16 <= n; i += 16) {
+        auto* d = reinterpret_cast<__m128i*>(dst + i);
+        const __m128i v = _mm_loadu_si128(d);
+        const __m128i c =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        const __m128i lo = blend_epi16_sse2(_mm_unpacklo_epi8(v, zero), a,
+                                            _mm_unpacklo_epi8(c, zero));
+        const __m128i hi = blend_epi16_sse2(_mm_unpackhi_epi8(v, zero), a,
+                                            _mm_unpackhi_epi8(c, zero));
+        const __m128i clear = _mm_cmpeq_epi8(c, zero);
+        _mm_storeu_si128(d,
+                         select_sse2(clear, v, _mm_packus_epi16(lo, hi)));
+    }
+    over_u8_scalar(dst + i, src + i, n - i, alpha);
+}
+
+// Only opaque layers are vectorized, blending 32 bit pixels needs 64 bit
+// products
+inline void over_i32_sse2(std::int32_t* dst, const std::int32_t* src,
+                          std::size_t n, std::uint8_t alpha) {
+    std::size_t i{0};
+    if (alpha == 255) {
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 4 <= n; i += 4) {
+            auto* d = reinterpret_cast<__m128i*>(dst + i);
+            const __m128i c =
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            _mm_storeu_si128(d, select_sse2(_mm_cmpeq_epi32(c, zero),
+                                            _mm_loadu_si128(d), c));
+        }
+    }
+    over_i32_scalar(dst + i, src + i, n - i, alpha);
+}
+
+// Multiply then add like the scalar loop, so all paths round alike
+inline void accumulate_u8_sse2(float* acc, const std::uint8_t* px,
+                               std::size_t n, float weight) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 w = _mm_set1_ps(weight);
+    std::size_t i{0};
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(px + i));
+        const __m128i lo = _mm_unpacklo_epi8(v, zero);
+        const __m128i hi = _mm_unpackhi_epi8(v, zero);
+        const __m128i quads[4] = {
+            _mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+            _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero)};
+        for (int q{0}; q < 4; q++) {
+            float* a = acc + i + 4 * q;
+            const __m128 term = _mm_mul_ps(w, _mm_cvtepi32_ps(quads[q]));
+            _mm_storeu_ps(a, _mm_add_ps(_mm_loadu_ps(a), term));
+        }
+    }
+    accumulate_u8_scalar(acc + i, px + i, n - i, weight);
+}
+
+inline void accumulate_i32_sse2(double* acc, const std::int32_t* px,
+                                std::size_t n, double weight) {
+    const __m128d w = _mm_set1_pd(weight);
+    std::size_t i{0};
+    for (; i + 2 <= n; i += 2) {
+        const __m128d v = _mm_cvtepi32_pd(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(px + i)));
+        _mm_storeu_pd(acc + i,
+                      _mm_add_pd(_mm_loadu_pd(acc + i), _mm_mul_pd(w, v)));
+    }
+    accumulate_i32_scalar(acc + i, px + i, n - i, weight);
+}
+
+// 16 pixels at a time: three rounds of byte unpacks transpose the 4 x 4
+// byte blocks, each round halving the distance between a channel's bytes
+inline void deinterleave_sse2(const std::uint8_t* rgba, std::uint8_t* r,
+                              std::uint8_t* g, std::uint8_t* b,
+                              std::uint8_t* a, std::size_t n) {
+    std::size_t i{0};
+    for (; i + 16 <= n; i += 16) {
+        const auto* in = reinterpret_cast<const __m128i*>(rgba + 4 * i);
+        const __m128i v0 = _mm_loadu_si128(in);
+        const __m128i v1 = _mm_loadu_si128(in + 1);
+        const __m128i v2 = _mm_loadu_si128(in + 2);
+        const __m128i v3 = _mm_loadu_si128(in + 3);
+        const __m128i u0 = _mm_unpacklo_epi8(v0, v1);
+        const __m128i u1 = _mm_unpackhi_epi8(v0, v1);
+        const __m128i u2 = _mm_unpacklo_epi8(v2, v3);
+        const __m128i u3 = _mm_unpackhi_epi8(v2, v3);
+        const __m128i w0 = _mm_unpacklo_epi8(u0, u1);
+        const __m128i w1 = _mm_unpackhi_epi8(u0, u1);
+        const __m128i w2 = _mm_unpacklo_epi8(u2, u3);
+        const __m128i w3 = _mm_unpackhi_epi8(u2, u3);
+        // 8 reds then 8 greens, 8 blues then 8 alphas
+        const __m128i rg0 = _mm_unpacklo_epi8(w0, w1);
+        const __m128i ba0 = _mm_unpackhi_epi8(w0, w1);
+        const __m128i rg1 = _mm_unpacklo_epi8(w2, w3);
+        const __m128i ba1 = _mm_unpackhi_epi8(w2, w3);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(r + i),
+                         _mm_unpacklo_epi64(rg0, rg1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(g + i),
+                         _mm_unpackhi_epi64(rg0, rg1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(b + i),
+                         _mm_unpacklo_epi64(ba0, ba1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(a + i),
+                         _mm_unpackhi_epi64(ba0, ba1));
+    }
+    deinterleave_scalar(rgba + 4 * i, r + i, g + i, b + i, a + i, n - i);
+}
+
+inline void interleave_sse2(std::uint8_t* rgba, const std::uint8_t* r,
+                            const std::uint8_t* g, const std::uint8_t* b,
+                            const std::uint8_t* a, std::size_t n) {
+    std::size_t i{0};
+    for (; i + 16 <= n; i += 16) {
+        const __m128i vr =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(r + i));
+        const __m128i vg =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(g + i));
+        const __m128i vb =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        const __m128i va =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        const __m128i rg_lo = _mm_unpacklo_epi8(vr, vg);
+        const __m128i rg_hi = _mm_unpackhi_epi8(vr, vg);
+        const __m128i ba_lo = _mm_unpacklo_epi8(vb, va);
+        const __m128i ba_hi = _mm_unpackhi_epi8(vb, va);
+        auto* out = reinterpret_cast<__m128i*>(rgba + 4 * i);
+        _mm_storeu_si128(out, _mm_unpacklo_epi16(rg_lo, ba_lo));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rg_lo, ba_lo));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rg_hi, ba_hi));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rg_hi, ba_hi));
+    }
+    interleave_scalar(rgba + 4 * i, r + i, g + i, b + i, a + i, n - i);
+}
+
+CANVAS_TARGET_AVX2 inline void scale_avx2(std::int32_t* px, std::size_t n,
+                                          std::int32_t f) {
+    const __m256i factor = _mm256_set1_epi32(f);
+    std::size_t i{0};
+    for (; i + 8 <= n; i += 8) {
+        auto* p = reinterpret_cast<__m256i*>(px + i);
+        _mm256_storeu_si256(p,
+                            _mm256_mullo_epi32(_mm256_loadu_si256(p), factor));
+    }
+    scale_scalar(px + i, n - i, f);
+}
+
+CANVAS_TARGET_AVX2 inline void add_avx2(std::int32_t* px, std::size_t n,
+                                        std::int32_t v) {
+    const __m256i addend = _mm256_set1_epi32(v);
+    std::size_t i{0};
+    for (; i + 8 <= n; i += 8) {
+        auto* p = reinterpret_cast<__m256i*>(px + i);
+        _mm256_storeu_si256(p, _mm256_add_epi32(_mm256_loadu_si256(p), addend));
+    }
+    add_scalar(px + i, n - i, v);
+}
+
+CANVAS_TARGET_AVX2 inline void clamp_avx2(std::int32_t* px, std::size_t n,
+                                          std::int32_t lo, std::int32_t hi) {
+    const __m256i low = _mm256_set1_epi32(lo);
+    const __m256i high = _mm256_set1_epi32(hi);
+    std::size_t i{0};
+    for (; i + 8 <= n; i += 8) {
+        auto* p = reinterpret_cast<__m256i*>(px + i);
+        const __m256i v = _mm256_loadu_si256(p);
+        _mm256_storeu_si256(p,
+                            _mm256_min_epi32(_mm256_max_epi32(v, low), high));
+    }
+    clamp_scalar(px + i, n - i, lo, hi);
+}
+
+CANVAS_TARGET_AVX2 inline void threshold_avx2(std::int32_t* px, std::size_t n,
+                                              std::int32_t level,
+                                              std::int32_t lo,
+                                              std::int32_t hi) {
+    const __m256i lvl = _mm256_set1_epi32(level);
+    const __m256i low = _mm256_set1_epi32(lo);
+    const __m256i high = _mm256_set1_epi32(hi);
+    std::size_t i{0};
+    for (; i + 8 <= n; i += 8) {
+        auto* p = reinterpret_cast<__m256i*>(px + i);
+        const __m256i below = _mm256_cmpgt_epi32(lvl, _mm256_loadu_si256(p));
+        _mm256_storeu_si256(p, _mm256_blendv_epi8(high, low, below));
+    }
+    threshold_scalar(px + i, n - i, level, lo, hi);
+}
+
+CANVAS_TARGET_AVX2 inline void max_u8_avx2(std::uint8_t* dst,
+                                           const std::uint8_t* src,
+                                           std::size_t n) {
+    std::size_t i{0};
+    for (; i + 32 <= n; i += 32) {
+        auto* d = reinterpret_cast<__m256i*>(dst + i);
+        const auto* s = reinterpret_cast<const __m256i*>(src + i);
+        _mm256_storeu_si256(d, _mm256_max_epu8(_mm256_loadu_si256(d),
+                                               _mm256_loadu_si256(s)));
+    }
+    max_u8_scalar(dst + i, src + i, n - i);
+}
+
+CANVAS_TARGET_AVX2 inline __m256i blend_epi16_avx2(__m256i dst, __m256i alpha,
+                                                   __m256i colour) {
+    const __m256i inverse = _mm256_sub_epi16(_mm256_set1_epi16(255), alpha);
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(colour, alpha),
+                                 _mm256_mullo_epi16(dst, inverse));
+    t = _mm256_add_epi16(t, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+// unpack and pack both work per 128 bit lane, so pixel order is kept
+CANVAS_TARGET_AVX2 inline void composite_u8_avx2(std::uint8_t* dst,
+                                                 const std::uint8_t* alpha,
+                                                 std::size_t n,
+                                                 std::uint8_t colour) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i c = _mm256_set1_epi16(colour);
+    std::size_t i{0};
+    for (; i + 32 <= n; i += 32) {
+        auto* d = reinterpret_cast<__m256i*>(dst + i);
+        const __m256i v = _mm256_loadu_si256(d);
+        const __m256i a =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(alpha + i));
+        const __m256i lo = blend_epi16_avx2(_mm256_unpacklo_epi8(v, zero),
+                                            _mm256_unpacklo_epi8(a, zero), c);
+        const __m256i hi = blend_epi16_avx2(_mm256_unpackhi_epi8(v, zero),
+                                            _mm256_unpackhi_epi8(a, zero), c);
+        _mm256_storeu_si256(d, _mm256_packus_epi16(lo, hi));
+    }
+    composite_u8_scalar(dst + i, alpha + i, n - i, colour);
+}
+
+CANVAS_TARGET_AVX2 inline void adds_u8_avx2(std::uint8_t* dst,
+                                            const std::uint8_t* src,
+                                            std::size_t n) {
+    std::size_t i{0};
+    for (; i + 32 <= n; i += 32) {
+        auto* d = reinterpret_cast<__m256i*>(dst + i);
+        const auto* s = reinterpret_cast<const __m256i*>(src + i);
+        _mm256_storeu_si256(d, _mm256_adds_epu8(_mm256_loadu_si256(d),
+                                                _mm256_loadu_si256(s)));
+    }
+    adds_u8_scalar(dst + i, src + i, n - i);
+}
+
+CANVAS_TARGET_AVX2 inline void adds_i32_avx2(std::int32_t* dst,
+                                             const std::int32_t* src,
+                                             std::size_t n) {
+    const __m256i max =
+        _mm256_set1_epi32(std::numeric_limits<std::int32_t>::max());
+    std::size_t i{0};
+    for (; i + 8 <= n; i += 8) {
+        auto* d = reinterpret_cast<__m256i*>(dst + i);
+        const __m256i a = _mm256_loadu_si256(d);
+        const __m256i b =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        const __m256i sum = _mm256_add_epi32(a, b);
+        const __m256i overflow = _mm256_and_si256(_mm256_xor_si256(a, sum),
+                                                  _mm256_xor_si256(b, sum));
+        const __m256i limit =
+            _mm256_xor_si256(_mm256_srai_epi32(a, 31), max);
+        // blendv_ps picks by the sign bit of each 32 bit lane
+        _mm256_storeu_si256(
+            d, _mm256_castps_si256(_mm256_blendv_ps(
+                   _mm256_castsi256_ps(sum), _mm256_castsi256_ps(limit),
+                   _mm256_castsi256_ps(overflow))));
+    }
+    adds_i32_scalar(dst + i, src + i, n - i);
+}
+
+CANVAS_TARGET_AVX2 inline void max_i32_avx2(std::int32_t* dst,
+                                            const std::int32_t* src,
+                                            std::size_t n) {
+    std::size_t i{0};
+    for (; i + 8 <= n; i += 8) {
+        auto* d = reinterpret_cast<__m256i*>(dst + i);
+        const auto* s = reinterpret_cast<const __m256i*>(src + i);
+        _mm256_storeu_si256(d, _mm256_max_epi32(_mm256_loadu_si256(d),
+                                                _mm256_loadu_si256(s)));
+    }
+    max_i32_scalar(dst + i, src + i, n - i);
+}
+
+CANVAS_TARGET_AVX2 inline void xor_avx2(std::byte* dst, const std::byte* src,
+                                        std::size_t n) {
+    std::size_t i{0};
+    for (; i + 32 <= n; i += 32) {
+        auto* d = reinterpret_cast<__m256i*>(dst + i);
+        const auto* s = reinterpret_cast<const __m256i*>(src + i);
+        _mm256_storeu_si256(d, _mm256_xor_si256(_mm256_loadu_si256(d),
+                                                _mm256_loadu_si256(s)));
+    }
+    xor_scalar(dst + i, src + i, n - i);
+}
+
+CANVAS_TARGET_AVX2 inline void over_u8_avx2(std::uint8_t* dst,
+                                            const std::uint8_t* src,
+                                            std::size_t n,
+                                            std::uint8_t alpha) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i a = _mm256_set1_epi16(alpha);
+    std::size_t i{0};
+    for (; i + 32 <= n; i += 32) {
+        auto* d = reinterpret_cast<__m256i*>(dst + i);
+        const __m256i v = _mm256_loadu_si256(d);
+        const __m256i c =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        const __m256i lo = blend_epi16_avx2(_mm256_unpacklo_epi8(v, zero), a,
+                                            _mm256_unpacklo_epi8(c, zero));
+        const __m256i hi = blend_epi16_avx2(_mm256_unpackhi_epi8(v, zero), a,
+                                            _mm256_unpackhi_epi8(c, zero));
+        const __m256i clear = _mm256_cmpeq_epi8(c, zero);
+        _mm256_storeu_si256(
+            d, _mm256_blendv_epi8(_mm256_packus_epi16(lo, hi), v, clear));
+    }
+    over_u8_scalar(dst + i, src + i, n - i, alpha);
+}
+
+CANVAS_TARGET_AVX2 inline void over_i32_avx2(std::int32_t* dst,
+                                             const std::int32_t* src,
+                                             std::size_t n,
+                                             std::uint8_t alpha) {
+    std::size_t i{0};
+    if (alpha == 255) {
+        const __m256i zero = _mm256_setzero_si256();
+        for (; i + 8 <= n; i += 8) {
+            auto* d = reinterpret_cast<__m256i*>(dst + i);
+            const __m256i c =
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            _mm256_storeu_si256(
+                d, _mm256_blendv_epi8(c, _mm256_loadu_si256(d),
+                                      _mm256_cmpeq_epi32(c, zero)));
+        }
+    }
+    over_i32_scalar(dst + i, src + i, n - i, alpha);
+}
+
+CANVAS_TARGET_AVX2 inline void accumulate_u8_avx2(float* acc,
+                                                  const std::uint8_t* px,
+                                                  std::size_t n,
+                                                  float weight) {
+    const __m256 w = _mm256_set1_ps(weight);
+    std::size_t i{0};
+    for (; i + 8 <= n; i += 8) {
+        const __m256i v = _mm256_cvtepu8_epi32(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(px + i)));
+        const __m256 term = _mm256_mul_ps(w, _mm256_cvtepi32_ps(v));
+        _mm256_storeu_ps(acc + i,
+                         _mm256_add_ps(_mm256_loadu_ps(acc + i), term));
+    }
+    accumulate_u8_scalar(acc + i, px + i, n - i, weight);
+}
+
+CANVAS_TARGET_AVX2 inline void accumulate_i32_avx2(double* acc,
+                                                   const std::int32_t* px,
+                                                   std::size_t n,
+                                                   double weight) {
+    const __m256d w = _mm256_set1_pd(weight);
+    std::size_t i{0};
+    for (; i + 4 <= n; i += 4) {
+        const __m256d v = _mm256_cvtepi32_pd(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(px + i)));
+        _mm256_storeu_pd(acc + i, _mm256_add_pd(_mm256_loadu_pd(acc + i),
+                                                _mm256_mul_pd(w, v)));
+    }
+    accumulate_i32_scalar(acc + i, px + i, n - i, weight);
+}
+
+// Loads 8 RGBA pixels and sorts their bytes into 8 reds, greens, blues
+// and alphas, one 64 bit quarter each. The byte shuffle groups the
+// channels of each 4 pixel dword quad, the dword permute pairs the quads
+// of the two 128 bit lanes.
+CANVAS_TARGET_AVX2 inline __m256i group_channels_avx2(const __m256i* in) {
+    const __m256i by_channel = _mm256_setr_epi8(
+        0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15,  //
+        0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+    const __m256i quarters = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    return _mm256_permutevar8x32_epi32(
+        _mm256_shuffle_epi8(_mm256_loadu_si256(in), by_channel), quarters);
+}
+
+// 32 pixels at a time, 64 bit unpacks and lane permutes assemble the
+// planes from the grouped channels
+CANVAS_TARGET_AVX2 inline void deinterleave_avx2(const std::uint8_t* rgba,
+                                                 std::uint8_t* r,
+                                                 std::uint8_t* g,
+                                                 std::uint8_t* b,
+                                                 std::uint8_t* a,
+                                                 std::size_t n) {
+    std::size_t i{0};
+    for (; i + 32 <= n; i += 32) {
+        const auto* in = reinterpret_cast<const __m256i*>(rgba + 4 * i);
+        const __m256i q0 = group_channels_avx2(in);
+        const __m256i q1 = group_channels_avx2(in + 1);
+        const __m256i q2 = group_channels_avx2(in + 2);
+        const __m256i q3 = group_channels_avx2(in + 3);
+        // Reds then blues, greens then alphas, per 128 bit lane
+        const __m256i rb01 = _mm256_unpacklo_epi64(q0, q1);
+        const __m256i ga01 = _mm256_unpackhi_epi64(q0, q1);
+        const __m256i rb23 = _mm256_unpacklo_epi64(q2, q3);
+        const __m256i ga23 = _mm256_unpackhi_epi64(q2, q3);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(r + i),
+                            _mm256_permute2x128_si256(rb01, rb23, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(b + i),
+                            _mm256_permute2x128_si256(rb01, rb23, 0x31));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(g + i),
+                            _mm256_permute2x128_si256(ga01, ga23, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(a + i),
+                            _mm256_permute2x128_si256(ga01, ga23, 0x31));
+    }
+    deinterleave_sse2(rgba + 4 * i, r + i, g + i, b + i, a + i, n - i);
+}
+
+// The SSE2 unpacks, which stay within 128 bit lanes, so the lanes of the
+// results are swapped back into pixel order
+CANVAS_TARGET_AVX2 inline void interleave_avx2(std::uint8_t* rgba,
+                                               const std::uint8_t* r,
+                                               const std::uint8_t* g,
+                                               const std::uint8_t* b,
+                                               const std::uint8_t* a,
+                                               std::size_t n) {
+    std::size_t i{0};
+    for (; i + 32 <= n; i += 32) {
+        const __m256i vr =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r + i));
+        const __m256i vg =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(g + i));
+        const __m256i vb =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        const __m256i va =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        const __m256i rg_lo = _mm256_unpacklo_epi8(vr, vg);
+        const __m256i rg_hi = _mm256_unpackhi_epi8(vr, vg);
+        const __m256i ba_lo = _mm256_unpacklo_epi8(vb, va);
+        const __m256i ba_hi = _mm256_unpackhi_epi8(vb, va);
+        const __m256i p0 = _mm256_unpacklo_epi16(rg_lo, ba_lo);
+        const __m256i p1 = _mm256_unpackhi_epi16(rg_lo, ba_lo);
+        const __m256i p2 = _mm256_unpacklo_epi16(rg_hi, ba_hi);
+        const __m256i p3 = _mm256_unpackhi_epi16(rg_hi, ba_hi);
+        auto* out = reinterpret_cast<__m256i*>(rgba + 4 * i);
+        _mm256_storeu_si256(out, _mm256_permute2x128_si256(p0, p1, 0x20));
+        _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(p2, p3, 0x20));
+        _mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(p0, p1, 0x31));
+        _mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(p2, p3, 0x31));
+    }
+    interleave_sse2(rgba + 4 * i, r + i, g + i, b + i, a + i, n - i);
+}
+
+// Four points at a time, one per 64 bit lane: x sits in the even dword and
+// y is shifted down to it for the signed multiplies. The sums are shifted
+// logically, which leaves the low dword of an arithmetic shift, and x' and
+// y' are blended back into the even and odd dwords. SSE2 has no signed
+// 32 x 32 bit multiply and emulating it loses to the scalar loop, so the
+// SSE2 table keeps that.
+CANVAS_TARGET_AVX2 inline void transform_avx2(std::int32_t* dst,
+                                              const std::int32_t* src,
+                                              std::size_t n,
+                                              const FixedAffine& m) {
+    const std::int64_t half{std::int64_t{1} << (m.fraction_bits - 1)};
+    const __m256i xx = _mm256_set1_epi64x(m.xx);
+    const __m256i xy = _mm256_set1_epi64x(m.xy);
+    const __m256i yx = _mm256_set1_epi64x(m.yx);
+    const __m256i yy = _mm256_set1_epi64x(m.yy);
+    const __m256i tx = _mm256_set1_epi64x(m.tx + half);
+    const __m256i ty = _mm256_set1_epi64x(m.ty + half);
+    std::size_t i{0};
+    for (; i + 4 <= n; i += 4) {
+        const __m256i v = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(src + 2 * i));
+        const __m256i vy = _mm256_srli_epi64(v, 32);
+        const __m256i x = _mm256_add_epi64(
+            _mm256_add_epi64(_mm256_mul_epi32(v, xx), _mm256_mul_epi32(vy, xy)),
+            tx);
+        const __m256i y = _mm256_add_epi64(
+            _mm256_add_epi64(_mm256_mul_epi32(v, yx), _mm256_mul_epi32(vy, yy)),
+            ty);
+        const __m256i out =
+            _mm256_blend_epi32(_mm256_srli_epi64(x, m.fraction_bits),
+                               _mm256_slli_epi64(y, 32 - m.fraction_bits),
+                               0xaa);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 2 * i), out);
+    }
+    transform_scalar(dst + 2 * i, src + 2 * i, n - i, m);
+}
+
+// Zeroes n bytes with non temporal stores, which go straight to memory
+// instead of pulling every line of the buffer into the cache first. SSE2
+// is enough since the store width makes no difference to the bandwidth.
+inline void zero_stream_sse2(std::byte* p, std::size_t n) {
+    const std::size_t head =
+        (16 - reinterpret_cast<std::uintptr_t>(p) % 16) % 16;
+    if (n < head + 16) {
+        std::memset(p, 0, n);
+        return;
+    }
+    std::memset(p, 0, head);
+    const __m128i zero = _mm_setzero_si128();
+    std::size_t i{head};
+    for (; i + 16 <= n; i += 16) {
+        _mm_stream_si128(reinterpret_cast<__m128i*>(p + i), zero);
+    }
+    // streaming stores are weakly ordered, fence before anyone reads
+    _mm_sfence();
+    std::memset(p + i, 0, n - i);
+}
+
+// NOLINTEND(portability-simd-intrinsics)
+#endif
+
+inline bool cpu_has_avx2() {
+#if CANVAS_KERNELS_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4]{};
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    // OSXSAVE and AVX, then check the OS saves the YMM registers
+    const bool os_avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) &&
+                        ((_xgetbv(0) & 0x6) == 0x6);
+    __cpuidex(info, 7, 0);
+    return os_avx && (info[1] & (1 << 5));
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+#else
+    return false;
+#endif
+}
+
+inline Isa best_isa() {
+#if CANVAS_KERNELS_X86
+    // SSE2 is part of the x86-64 baseline
+    return cpu_has_avx2() ? Isa::AVX2 : Isa::SSE2;
+#else
+    return Isa::SCALAR;
+#endif
+}
+
+inline const KernelTable& table_for(Isa isa) {
+    static constexpr KernelTable scalar{
+        scale_scalar,          add_scalar,            clamp_scalar,
+        threshold_scalar,      max_u8_scalar,         composite_u8_scalar,
+        adds_u8_scalar,        adds_i32_scalar,       max_i32_scalar,
+        xor_scalar,            over_u8_scalar,        over_i32_scalar,
+        accumulate_u8_scalar,  accumulate_i32_scalar, deinterleave_scalar,
+        interleave_scalar,     transform_scalar};
+#if CANVAS_KERNELS_X86
+    static constexpr KernelTable sse2{
+        scale_sse2,          add_sse2,            clamp_sse2,
+        threshold_sse2,      max_u8_sse2,         composite_u8_sse2,
+        adds_u8_sse2,        adds_i32_sse2,       max_i32_sse2,
+        xor_sse2,            over_u8_sse2,        over_i32_sse2,
+        accumulate_u8_sse2,  accumulate_i32_sse2, deinterleave_sse2,
+        interleave_sse2,     transform_scalar};
+    static constexpr KernelTable avx2{
+        scale_avx2,          add_avx2,            clamp_avx2,
+        threshold_avx2,      max_u8_avx2,         composite_u8_avx2,
+        adds_u8_avx2,        adds_i32_avx2,       max_i32_avx2,
+        xor_avx2,            over_u8_avx2,        over_i32_avx2,
+        accumulate_u8_avx2,  accumulate_i32_avx2, deinterleave_avx2,
+        interleave_avx2,     transform_avx2};
+    switch (isa) {
+        case Isa::AVX2:
+            return avx2;
+        case Isa::SSE2:
+            return sse2;
+        case Isa::SCALAR:
+            break;
+    }
+#endif
+    return scalar;
+}
+
+inline Isa& current_isa() {
+    static Isa isa = best_isa();
+    return isa;
+}
+
+inline const KernelTable& kernels() { return table_for(current_isa()); }
+
+}  // namespace detail
+
+inline Isa active_isa() { return detail::current_isa(); }
+
+// Forces a narrower instruction set, e.g. to compare paths. Requests wider
+// than the CPU supports fall back to the best available.
+inline Isa set_isa(Isa isa) {
+    const Isa best = detail::best_isa();
+    detail::current_isa() =
+        static_cast<std::uint8_t>(isa) > static_cast<std::uint8_t>(best) ? best
+                                                                         : isa;
+    return detail::current_isa();
+}
+
+inline void scale(std::span<std::int32_t> px, std::int32_t factor) {
+    detail::kernels().scale(px.data(), px.size(), factor);
+}
+
+inline void add(std::span<std::int32_t> px, std::int32_t value) {
+    detail::kernels().add(px.data(), px.size(), value);
+}
+
+inline void clamp(std::span<std::int32_t> px, std::int32_t lo,
+                  std::int32_t hi) {
+    detail::kernels().clamp(px.data(), px.size(), lo, hi);
+}
+
+inline void threshold(std::span<std::int32_t> px, std::int32_t level,
+                      std::int32_t lo, std::int32_t hi) {
+    detail::kernels().threshold(px.data(), px.size(), level, lo, hi);
+}
+
+// dst = max(dst, src), how coverage from overlapping shapes combines.
+// src must be at least as long as dst.
+inline void max_coverage(std::span<std::uint8_t> dst,
+                         std::span<const std::uint8_t> src) {
+    detail::kernels().max_u8(dst.data(), src.data(), dst.size());
+}
+
+// Blends colour over dst by the coverage in alpha, 255 being fully covered.
+// alpha must be at least as long as dst.
+inline void composite(std::span<std::uint8_t> dst,
+                      std::span<const std::uint8_t> alpha,
+                      std::uint8_t colour) {
+    detail::kernels().composite_u8(dst.data(), alpha.data(), dst.size(),
+                                   colour);
+}
+
+// Row kernels for composing canvases, dst op= src. src must be at least as
+// long as dst.
+// dst = dst + src, clamped to the pixel range
+inline void add_saturate(std::span<std::uint8_t> dst,
+                         std::span<const std::uint8_t> src) {
+    detail::kernels().adds_u8(dst.data(), src.data(), dst.size());
+}
+inline void add_saturate(std::span<std::int32_t> dst,
+                         std::span<const std::int32_t> src) {
+    detail::kernels().adds_i32(dst.data(), src.data(), dst.size());
+}
+
+// dst = max(dst, src)
+inline void maximum(std::span<std::uint8_t> dst,
+                    std::span<const std::uint8_t> src) {
+    max_coverage(dst, src);
+}
+inline void maximum(std::span<std::int32_t> dst,
+                    std::span<const std::int32_t> src) {
+    detail::kernels().max_i32(dst.data(), src.data(), dst.size());
+}
+
+// dst ^= src, bytewise so it serves every pixel type
+inline void bitwise_xor(std::span<std::byte> dst,
+                        std::span<const std::byte> src) {
+    detail::kernels().xor_bytes(dst.data(), src.data(), dst.size());
+}
+
+// Layer src over dst with opacity alpha. Source pixels of 0 are
+// transparent and leave dst alone.
+inline void over(std::span<std::uint8_t> dst,
+                 std::span<const std::uint8_t> src, std::uint8_t alpha) {
+    detail::kernels().over_u8(dst.data(), src.data(), dst.size(), alpha);
+}
+inline void over(std::span<std::int32_t> dst,
+                 std::span<const std::int32_t> src, std::uint8_t alpha) {
+    detail::kernels().over_i32(dst.data(), src.data(), dst.size(), alpha);
+}
+
+// acc += weight * px, the vertical pass of resampling. px must be at least
+// as long as acc.
+inline void accumulate(std::span<float> acc, std::span<const std::uint8_t> px,
+                       float weight) {
+    detail::kernels().accumulate_u8(acc.data(), px.data(), acc.size(),
+                                    weight);
+}
+inline void accumulate(std::span<double> acc,
+                       std::span<const std::int32_t> px, double weight) {
+    detail::kernels().accumulate_i32(acc.data(), px.data(), acc.size(),
+                                     weight);
+}
+
+// Splits rgba.size() / 4 interleaved RGBA8 pixels into one plane per
+// channel, each at least that many bytes long
+inline void deinterleave_rgba(std::span<const std::uint8_t> rgba,
+                              std::span<std::uint8_t> r,
+                              std::span<std::uint8_t> g,
+                              std::span<std::uint8_t> b,
+                              std::span<std::uint8_t> a) {
+    detail::kernels().deinterleave(rgba.data(), r.data(), g.data(), b.data(),
+                                   a.data(), rgba.size() / 4);
+}
+
+// Merges four planes back into rgba.size() / 4 interleaved pixels
+inline void interleave_rgba(std::span<std::uint8_t> rgba,
+                            std::span<const std::uint8_t> r,
+                            std::span<const std::uint8_t> g,
+                            std::span<const std::uint8_t> b,
+                            std::span<const std::uint8_t> a) {
+    detail::kernels().interleave(rgba.data(), r.data(), g.data(), b.data(),
+                                 a.data(), rgba.size() / 4);
+}
+
+// Applies m to the points in xy, stored as x, y pairs, writing them to
+// dst. dst must be at least as long as xy and may be the same span.
+inline void transform_points(std::span<std::int32_t> dst,
+                             std::span<const std::int32_t> xy,
+                             const FixedAffine& m) {
+    detail::kernels().transform(dst.data(), xy.data(), xy.size() / 2, m);
+}
+
+// Buffers at least this large are cleared with streaming stores. Smaller
+// ones are likely to be drawn on straight away, so they are better left in
+// the cache.
+inline constexpr std::size_t stream_threshold{std::size_t{1} << 20};
+
+// Sets every byte of buf to zero
+inline void zero_fill(std::span<std::byte> buf) {
+#if CANVAS_KERNELS_X86
+    if (buf.size() >= stream_threshold) {
+        detail::zero_stream_sse2(buf.data(), buf.size());
+        return;
+    }
+#endif
+    std::memset(buf.data(), 0, buf.size());
+}
+
+// Canvas overloads. 32 bit pixels take the vector kernels, other pixel
+// types use a plain loop the compiler is free to vectorize.
+template <typename Pixel>
+void scale(BasicCanvas<Pixel>& cv, Pixel factor) {
+    if constexpr (std::same_as<Pixel, std::int32_t>) {
+        scale(cv.pixels(), factor);
+    } else {
+        for (auto& p : cv.pixels()) p = static_cast<Pixel>(p * factor);
+    }
+}
+
+template <typename Pixel>
+void add(BasicCanvas<Pixel>& cv, Pixel value) {
+    if constexpr (std::same_as<Pixel, std::int32_t>) {
+        add(cv.pixels(), value);
+    } else {
+        for (auto& p : cv.pixels()) p = static_cast<Pixel>(p + value);
+    }
+}
+
+template <typename Pixel>
+void clamp(BasicCanvas<Pixel>& cv, Pixel lo, Pixel hi) {
+    if constexpr (std::same_as<Pixel, std::int32_t>) {
+        clamp(cv.pixels(), lo, hi);
+    } else {
+        for (auto& p : cv.pixels()) p = p < lo ? lo : (p > hi ? hi : p);
+    }
+}
+
+template <typename Pixel>
+void threshold(BasicCanvas<Pixel>& cv, Pixel level, Pixel lo, Pixel hi) {
+    if constexpr (std::same_as<Pixel, std::int32_t>) {
+        threshold(cv.pixels(), level, lo, hi);
+    } else {
+        for (auto& p : cv.pixels()) p = p < level ? lo : hi;
+    }
+}
+
+// Blends colour over cv by an alpha canvas of the same size. 8 bit canvases
+// take the vector kernel, wider pixels are blended one at a time.
+template <typename Pixel>
+void composite(BasicCanvas<Pixel>& cv, const Canvas8& alpha, Pixel colour) {
+    if (alpha.get_width() != cv.get_width() ||
+        alpha.get_height() != cv.get_height())
+        return;
+    if constexpr (std::same_as<Pixel, std::uint8_t>) {
+        composite(cv.pixels(), alpha.pixels(), colour);
+    } else {
+        const auto a = alpha.pixels();
+        auto px = cv.pixels();
+        for (std::size_t i{0}; i < px.size(); i++) {
+            px[i] = detail::blend_wide(px[i], a[i], colour);
+        }
+    }
+}
+
+}  // namespace canvas_kernels
+
+#endif  // CANVAS_KERNELS_H
@@ -0,0 +1,174 @@
+#ifndef CANVAS_POOL_H
+#define CANVAS_POOL_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "canvas.hpp"
+#include "canvas_kernels.hpp"
+
+// Recycles pixel buffers for pipelines that create and drop many canvases
+// of the same few sizes, e.g. one scratch canvas per frame.
+// acquire(w, h) hands out a lease: an ordinary shared_ptr<BasicCanvas>
+// viewing a pooled buffer, so myDrawer and anything else taking a canvas
+// pointer can use it. When the last copy of the lease goes away the buffer
+// goes back to the pool instead of being freed. A lease may outlive the
+// pool, its buffer is then simply freed.
+// Buffers are grouped by size class, the pixel count rounded up to a power
+// of two, so canvases of different shapes but similar area share buffers.
+// A leased canvas starts all Pixel{} and fully dirty, cleared with
+// canvas_kernels::zero_fill (streaming stores for large buffers) rather
+// than reallocated. acquire() and releasing leases are thread safe.
+template <typename Pixel = int>
+class CanvasPool {
+    static_assert(std::is_arithmetic_v<Pixel> && !std::is_same_v<Pixel, bool>,
+                  "pooled pixels must be zero when all their bytes are");
+
+   public:
+    using Lease = std::shared_ptr<BasicCanvas<Pixel>>;
+
+    // Buffers start 64 byte aligned, on a cache line
+    static constexpr std::size_t buffer_alignment{64};
+    // The smallest size class, in pixels
+    static constexpr std::size_t min_class_pixels{256};
+
+    // Buffers returned while the pool caches max_cached_bytes are freed
+    explicit CanvasPool(const std::size_t max_cached_bytes =
+                            std::numeric_limits<std::size_t>::max())
+        : shared{std::make_shared<Shared>()} {
+        shared->limit = max_cached_bytes;
+    }
+
+    CanvasPool(const CanvasPool&) = delete;
+    CanvasPool& operator=(const CanvasPool&) = delete;
+
+    // A cleared w x h canvas, nullptr if the buffer cannot be allocated
+    Lease acquire(const std::size_t w, const std::size_t h) {
+        constexpr std::size_t max_pixels =
+            std::numeric_limits<std::size_t>::max() / sizeof(Pixel);
+        if (h != 0 && w > max_pixels / h) return nullptr;
+        const std::size_t n = w * h;
+        const std::size_t cls = size_class(n);
+        if (cls >= class_count || (std::size_t{1} << cls) > max_pixels)
+            return nullptr;
+        Buffer buffer = take(cls);
+        if (!buffer) return nullptr;
+        auto slot = std::make_shared<Slot>(shared, std::move(buffer), cls);
+        canvas_kernels::zero_fill(std::as_writable_bytes(
+            std::span<Pixel>(slot->buffer.get(), n)));
+        slot->canvas =
+            BasicCanvas<Pixel>(std::span<Pixel>(slot->buffer.get(), n), w, h);
+        return {slot, &slot->canvas};
+    }
+
+    // Frees every cached buffer, leased ones are unaffected
+    void trim() {
+        std::lock_guard lock{shared->lock};
+        for (auto& list : shared->free) list.clear();
+        shared->cached = 0;
+    }
+
+    // Buffers waiting for reuse and the memory they hold
+    std::size_t cached_buffers() const {
+        std::lock_guard lock{shared->lock};
+        std::size_t n{0};
+        for (const auto& list : shared->free) n += list.size();
+        return n;
+    }
+    std::size_t cached_bytes() const {
+        std::lock_guard lock{shared->lock};
+        return shared->cached;
+    }
+
+    // Buffers allocated so far, acquire() calls that could not reuse one
+    std::size_t allocations() const {
+        std::lock_guard lock{shared->lock};
+        return shared->allocated;
+    }
+
+   private:
+    struct AlignedDelete {
+        void operator()(Pixel* p) const {
+            ::operator delete[](p, std::align_val_t{buffer_alignment});
+        }
+    };
+    using Buffer = std::unique_ptr<Pixel[], AlignedDelete>;
+
+    // size_t has this many powers of two
+    static constexpr std::size_t class_count{
+        std::numeric_limits<std::size_t>::digits};
+
+    struct Shared {
+        mutable std::mutex lock;
+        std::array<std::vector<Buffer>, class_count> free;
+        std::size_t cached{0};
+        std::size_t limit{0};
+        std::size_t allocated{0};
+    };
+
+    // What a lease owns: the buffer and the canvas viewing it. Destroying
+    // it hands the buffer back.
+    struct Slot {
+        std::shared_ptr<Shared> pool;
+        Buffer buffer;
+        std::size_t cls;
+        BasicCanvas<Pixel> canvas{0, 0};
+
+        Slot(std::shared_ptr<Shared> p, Buffer b, const std::size_t c)
+            : pool{std::move(p)}, buffer{std::move(b)}, cls{c} {}
+        Slot(const Slot&) = delete;
+        Slot& operator=(const Slot&) = delete;
+
+        ~Slot() {
+            std::lock_guard lock{pool->lock};
+            const std::size_t bytes = class_bytes(cls);
+            if (pool->cached + bytes > pool->limit) return;
+            pool->free[cls].push_back(std::move(buffer));
+            pool->cached += bytes;
+        }
+    };
+
+    std::shared_ptr<Shared> shared;
+
+    static std::size_t size_class(const std::size_t n) {
+        return std::bit_width(std::max(n, min_class_pixels) - 1);
+    }
+    static std::size_t class_bytes(const std::size_t cls) {
+        return (std::size_t{1} << cls) * sizeof(Pixel);
+    }
+
+    // A cached buffer of class cls, or a new one (null if out of memory)
+    Buffer take(const std::size_t cls) {
+        {
+            std::lock_guard lock{shared->lock};
+            auto& list = shared->free[cls];
+            if (!list.empty()) {
+                Buffer b = std::move(list.back());
+                list.pop_back();
+                shared->cached -= class_bytes(cls);
+                return b;
+            }
+        }
+        Buffer b{static_cast<Pixel*>(
+            ::operator new[](class_bytes(cls),
+                             std::align_val_t{buffer_alignment},
+                             std::nothrow))};
+        if (b) {
+            std::lock_guard lock{shared->lock};
+            shared->allocated++;
+        }
+        return b;
+    }
+};
+
+#endif  // CANVAS_POOL_H
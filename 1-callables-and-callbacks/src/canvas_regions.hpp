@@ -0,0 +1,367 @@
+#ifndef CANVAS_REGIONS_H
+#define CANVAS_REGIONS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "canvas.hpp"
+#include "geometry.hpp"
+#include "work_stealing_pool.hpp"
+
+// Region operations on canvas pixels.
+//   flood_fill         recolours the region of equal pixels around a seed,
+//                      one horizontal run at a time from a stack of spans
+//   label_components   numbers the connected regions of equal, non
+//                      background pixels with union-find
+// The _tiled variants split the canvas into square tiles on a
+// WorkStealingPool. Each tile is labelled on its own, then a merge step
+// joins the sets that meet across tile edges. Results are identical to
+// the serial versions.
+
+// Which neighbours a pixel is connected to
+enum class Connectivity : std::uint8_t { FOUR = 0x04, EIGHT = 0x08 };
+
+// Connected regions of a canvas. labels holds 0 for background pixels and
+// 1 .. count for the rest, numbered in the raster order of each region's
+// first pixel.
+struct Components {
+    Canvas32 labels{0, 0};
+    std::size_t count{0};
+};
+
+namespace regions {
+
+constexpr std::size_t default_tile_size{256};
+
+// Union-find over pixel indices. A set's root is its smallest index, i.e.
+// its first pixel in raster order, and every parent comes before its
+// child. Pixels outside every set are none.
+class PixelSets {
+   public:
+    static constexpr std::uint32_t none{
+        std::numeric_limits<std::uint32_t>::max()};
+
+    explicit PixelSets(const std::size_t n) : parent(n, none) {}
+
+    void make(const std::uint32_t i) { parent[i] = i; }
+    // Adds i to the set of an earlier pixel n
+    void attach(const std::uint32_t i, const std::uint32_t n) {
+        parent[i] = find(n);
+    }
+    bool contains(const std::uint32_t i) const { return parent[i] != none; }
+
+    // With path halving. Only safe while no other thread uses the set.
+    std::uint32_t find(std::uint32_t i) {
+        while (parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    }
+    // Points every pixel straight at its root. One raster pass is enough
+    // since a pixel's parent has already been pointed at the root.
+    void flatten() {
+        for (std::uint32_t i{0}; i < parent.size(); i++) {
+            if (contains(i)) parent[i] = parent[parent[i]];
+        }
+    }
+
+    void unite(const std::uint32_t a, const std::uint32_t b) {
+        const std::uint32_t ra = find(a);
+        const std::uint32_t rb = find(b);
+        if (ra < rb)
+            parent[rb] = ra;
+        else if (rb < ra)
+            parent[ra] = rb;
+    }
+
+    std::vector<std::uint32_t> parent;
+};
+
+// Tiles of size x size covering a w x h canvas, row after row
+inline std::vector<Rect> tile_grid(const std::size_t w, const std::size_t h,
+                                   std::size_t size) {
+    size = std::max<std::size_t>(size, 1);
+    std::vector<Rect> tiles;
+    for (std::size_t y{0}; y < h; y += size) {
+        for (std::size_t x{0}; x < w; x += size) {
+            tiles.push_back({static_cast<int>(x), static_cast<int>(y),
+                             static_cast<int>(std::min(x + size, w)),
+                             static_cast<int>(std::min(y + size, h))});
+        }
+    }
+    return tiles;
+}
+
+// Joins pixel (x, y) with its members among the neighbours above and to
+// the left that lie inside area. same(a, b) says whether two member pixels
+// connect.
+template <typename Pixel, typename Same>
+void join_backward(const BasicCanvas<Pixel>& cv, PixelSets& sets,
+                   const Rect& area, const int x, const int y,
+                   const Connectivity conn, Same& same) {
+    const std::size_t w = cv.get_width();
+    const auto i = static_cast<std::uint32_t>(y * w + x);
+    const Pixel p = cv.at(x, y);
+    auto join = [&](const int nx, const int ny) {
+        if (!area.contains(nx, ny)) return;
+        const auto n = static_cast<std::uint32_t>(ny * w + nx);
+        if (sets.contains(n) && same(cv.at(nx, ny), p)) sets.unite(i, n);
+    };
+    join(x - 1, y);
+    join(x, y - 1);
+    if (conn == Connectivity::EIGHT) {
+        join(x - 1, y - 1);
+        join(x + 1, y - 1);
+    }
+}
+
+// Builds the sets of member pixels connected by same, tile by tile on run
+// (a serial loop or a pool), then merges across tile edges. Returns
+// nullopt when the canvas has too many pixels for 32 bit indices.
+template <typename Pixel, typename Member, typename Same, typename Run>
+std::optional<PixelSets> connect(const BasicCanvas<Pixel>& cv,
+                                 const Connectivity conn,
+                                 const std::size_t tile_size, Member member,
+                                 Same same, Run&& run) {
+    const std::size_t w = cv.get_width(), h = cv.get_height();
+    if (h != 0 && w >= PixelSets::none / h) return std::nullopt;
+    PixelSets sets(w * h);
+    const auto tiles = tile_grid(w, h, tile_size);
+
+    // Each tile only touches its own pixels' entries
+    run(tiles.size(), [&](const std::size_t t) {
+        const Rect& tile = tiles[t];
+        const auto x0 = static_cast<std::size_t>(tile.x0);
+        const auto x1 = static_cast<std::size_t>(tile.x1);
+        for (int y{tile.y0}; y < tile.y1; y++) {
+            const Pixel* line = cv.row(y).data();
+            const Pixel* above = y > tile.y0 ? cv.row(y - 1).data() : nullptr;
+            const auto i0 = static_cast<std::uint32_t>(y * w);
+            for (std::size_t x{x0}; x < x1; x++) {
+                const Pixel p = line[x];
+                if (!member(p)) continue;
+                const auto i = static_cast<std::uint32_t>(i0 + x);
+                // The first connected neighbour takes i into its set, the
+                // others are united with it
+                bool joined{false};
+                auto join = [&](const std::uint32_t n, const Pixel q) {
+                    if (!sets.contains(n) || !same(q, p)) return;
+                    if (joined) {
+                        sets.unite(i, n);
+                    } else {
+                        sets.attach(i, n);
+                        joined = true;
+                    }
+                };
+                if (x > x0) join(i - 1, line[x - 1]);
+                if (above != nullptr) {
+                    const auto up = static_cast<std::uint32_t>(i - w);
+                    join(up, above[x]);
+                    if (conn == Connectivity::EIGHT) {
+                        if (x > x0) join(up - 1, above[x - 1]);
+                        if (x + 1 < x1) join(up + 1, above[x + 1]);
+                    }
+                }
+                if (!joined) sets.make(i);
+            }
+        }
+    });
+
+    // Merge: only pixels on a tile's top row, left or right column have
+    // neighbours in another tile that an earlier pass did not join
+    if (tiles.size() > 1) {
+        const Rect full = canvas_rect(cv);
+        for (const Rect& tile : tiles) {
+            auto edge = [&](const int x, const int y) {
+                if (sets.contains(static_cast<std::uint32_t>(y * w + x)))
+                    join_backward(cv, sets, full, x, y, conn, same);
+            };
+            for (int x{tile.x0}; x < tile.x1; x++) edge(x, tile.y0);
+            for (int y{tile.y0 + 1}; y < tile.y1; y++) {
+                edge(tile.x0, y);
+                if (tile.x1 - 1 > tile.x0) edge(tile.x1 - 1, y);
+            }
+        }
+    }
+    return sets;
+}
+
+// Labels from finished sets in one raster pass. A pixel's parent comes
+// before it, so the parent's label is already known.
+inline Components number_sets(const PixelSets& sets, const std::size_t w,
+                              const std::size_t h) {
+    Components out;
+    out.labels = Canvas32(w, h);
+    const auto px = out.labels.pixels();
+    for (std::uint32_t i{0}; i < px.size(); i++) {
+        if (!sets.contains(i)) continue;
+        const std::uint32_t p = sets.parent[i];
+        px[i] = p == i ? static_cast<std::uint32_t>(++out.count) : px[p];
+    }
+    return out;
+}
+
+inline auto serial_run() {
+    return [](const std::size_t n, auto&& fn) {
+        for (std::size_t i{0}; i < n; i++) fn(i);
+    };
+}
+
+inline auto pool_run(WorkStealingPool& pool) {
+    return [&pool](const std::size_t n, auto&& fn) {
+        pool.parallel_for(n, fn);
+    };
+}
+
+template <typename Pixel>
+Components label(const BasicCanvas<Pixel>& cv, const Connectivity conn,
+                 const std::size_t tile_size, auto&& run) {
+    auto sets = connect(
+        cv, conn, tile_size, [](const Pixel p) { return p != Pixel{}; },
+        [](const Pixel a, const Pixel b) { return a == b; }, run);
+    if (!sets) return {};
+    return number_sets(*sets, cv.get_width(), cv.get_height());
+}
+
+}  // namespace regions
+
+// Replaces the region of pixels equal to the seed pixel and connected to
+// it with colour. Each run of the region is found and filled whole, then
+// the spans above and below it are pushed onto a stack, so memory grows
+// with the region's outline rather than its area. Returns the number of
+// pixels filled.
+template <typename Pixel>
+std::size_t flood_fill(BasicCanvas<Pixel>& cv, const Point seed,
+                       const Pixel colour,
+                       const Connectivity conn = Connectivity::FOUR) {
+    if (!canvas_rect(cv).contains(seed.x, seed.y)) return 0;
+    const BasicCanvas<Pixel>& view = cv;
+    const Pixel target = view.at(seed.x, seed.y);
+    if (target == colour) return 0;
+    const std::size_t w = cv.get_width(), h = cv.get_height();
+    // Diagonal neighbours reach one column past each end of a run
+    const std::size_t reach = conn == Connectivity::EIGHT ? 1 : 0;
+
+    struct Span {
+        std::size_t x_begin, x_end, y;
+    };
+    std::vector<Span> stack;
+    std::size_t filled{0};
+
+    // Fills the run through x on row y and queues the rows next to it
+    auto fill_run = [&](std::size_t x, const std::size_t y) {
+        const auto line = view.row(y);
+        std::size_t begin{x};
+        while (begin > 0 && line[begin - 1] == target) begin--;
+        while (x < w && line[x] == target) x++;
+        cv.fill_row_segment(y, begin, x, colour);
+        filled += x - begin;
+        if (y > 0) stack.push_back({begin, x, y - 1});
+        if (y + 1 < h) stack.push_back({begin, x, y + 1});
+        return x;
+    };
+
+    fill_run(static_cast<std::size_t>(seed.x),
+             static_cast<std::size_t>(seed.y));
+    while (!stack.empty()) {
+        const Span span = stack.back();
+        stack.pop_back();
+        const auto line = view.row(span.y);
+        std::size_t x = span.x_begin > reach ? span.x_begin - reach : 0;
+        const std::size_t end = std::min(span.x_end + reach, w);
+        while (x < end) {
+            if (line[x] == target)
+                x = fill_run(x, span.y);
+            else
+                x++;
+        }
+    }
+    return filled;
+}
+
+// flood_fill on a pool. The region is found with the tiled labeller, then
+// rows are recoloured in parallel. Pays off for regions covering a large
+// part of a large canvas, the serial fill only touches the region itself.
+template <typename Pixel>
+std::size_t flood_fill_tiled(
+    BasicCanvas<Pixel>& cv, const Point seed, const Pixel colour,
+    WorkStealingPool& pool, const Connectivity conn = Connectivity::FOUR,
+    const std::size_t tile_size = regions::default_tile_size) {
+    if (!canvas_rect(cv).contains(seed.x, seed.y)) return 0;
+    const BasicCanvas<Pixel>& view = cv;
+    const Pixel target = view.at(seed.x, seed.y);
+    if (target == colour) return 0;
+    const std::size_t w = cv.get_width(), h = cv.get_height();
+    auto sets = regions::connect(
+        view, conn, tile_size, [target](const Pixel p) { return p == target; },
+        [](Pixel, Pixel) { return true; }, regions::pool_run(pool));
+    if (!sets) return flood_fill(cv, seed, colour, conn);
+    sets->flatten();
+    const std::uint32_t region =
+        sets->parent[static_cast<std::size_t>(seed.y) * w + seed.x];
+
+    // Rows of a band are only written by its task. Tracking is paused
+    // meanwhile, each band records its rows' spans and they are marked
+    // after.
+    const std::size_t band = std::max<std::size_t>(tile_size, 1);
+    const std::size_t bands = (h + band - 1) / band;
+    std::vector<DirtyTracker::Span> spans(h, {w, 0});
+    std::vector<std::size_t> counts(bands, 0);
+    const bool was_tracking = cv.is_dirty_tracking();
+    cv.set_dirty_tracking(false);
+    pool.parallel_for(bands, [&](const std::size_t b) {
+        for (std::size_t y{b * band}; y < std::min(h, (b + 1) * band); y++) {
+            std::size_t x{0};
+            while (x < w) {
+                auto in = [&](const std::size_t i) {
+                    const auto n = static_cast<std::uint32_t>(y * w + i);
+                    return sets->parent[n] == region;
+                };
+                if (!in(x)) {
+                    x++;
+                    continue;
+                }
+                const std::size_t begin{x};
+                while (x < w && in(x)) x++;
+                cv.fill_row_segment(y, begin, x, colour);
+                counts[b] += x - begin;
+                spans[y].begin = std::min(spans[y].begin, begin);
+                spans[y].end = std::max(spans[y].end, x);
+            }
+        }
+    });
+    cv.set_dirty_tracking(was_tracking);
+    for (std::size_t y{0}; y < h; y++) {
+        if (!spans[y].empty()) cv.mark_dirty(y, spans[y].begin, spans[y].end);
+    }
+    std::size_t filled{0};
+    for (const std::size_t n : counts) filled += n;
+    return filled;
+}
+
+// Labels the connected regions of equal pixels other than Pixel{}. An
+// empty result (count 0, 0 x 0 labels) also stands for a canvas with 2^32
+// pixels or more, which 32 bit labels cannot number.
+template <typename Pixel>
+Components label_components(const BasicCanvas<Pixel>& cv,
+                            const Connectivity conn = Connectivity::FOUR) {
+    const std::size_t whole = std::max(cv.get_width(), cv.get_height());
+    return regions::label(cv, conn, whole, regions::serial_run());
+}
+
+template <typename Pixel>
+Components label_components_tiled(
+    const BasicCanvas<Pixel>& cv, WorkStealingPool& pool,
+    const Connectivity conn = Connectivity::FOUR,
+    const std::size_t tile_size = regions::default_tile_size) {
+    return regions::label(cv, conn, tile_size, regions::pool_run(pool));
+}
+
+#endif  // CANVAS_REGIONS_H
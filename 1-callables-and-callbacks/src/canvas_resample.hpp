@@ -0,0 +1,189 @@
+#ifndef CANVAS_RESAMPLE_H
+#define CANVAS_RESAMPLE_H
+
+#include <algorithm>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "canvas.hpp"
+#include "canvas_kernels.hpp"
+
+// Resampling a canvas to another size, e.g. for thumbnails.
+//   NEAREST   copies the source pixel under each output pixel's centre
+//   BILINEAR  interpolates the two nearest source pixels on each axis,
+//             best for enlarging and mild shrinking
+//   BOX       averages the source area an output pixel covers, weighting
+//             partly covered pixels by the overlap, best for thumbnails
+// The filters are separable. Each output row is first summed vertically
+// from the source rows it needs into one accumulator row, which is
+// vectorized across the row, then filtered horizontally. Only one
+// accumulator row is kept, so memory does not grow with the source.
+enum class ResampleFilter : std::uint8_t {
+    NEAREST = 0x01,
+    BILINEAR = 0x02,
+    BOX = 0x03
+};
+
+namespace canvas_kernels {
+
+namespace detail {
+
+// Source pixels and weights contributing to each output pixel along one
+// axis. Output i uses sources first[i] .. first[i] + n - 1 with weights
+// weights[offset[i] ..], where n = offset[i + 1] - offset[i].
+template <typename Acc>
+struct Taps {
+    std::vector<std::size_t> first;
+    std::vector<std::size_t> offset;
+    std::vector<Acc> weights;
+
+    std::size_t count(const std::size_t i) const {
+        return offset[i + 1] - offset[i];
+    }
+};
+
+template <typename Acc>
+Taps<Acc> make_taps(const std::size_t src, const std::size_t dst,
+                    const ResampleFilter filter) {
+    Taps<Acc> taps;
+    taps.first.reserve(dst);
+    taps.offset.reserve(dst + 1);
+    taps.offset.push_back(0);
+    const double ratio = static_cast<double>(src) / static_cast<double>(dst);
+    const double last = static_cast<double>(src - 1);
+    for (std::size_t i{0}; i < dst; i++) {
+        const double centre = (static_cast<double>(i) + 0.5) * ratio;
+        switch (filter) {
+            case ResampleFilter::NEAREST:
+                // floor(centre) in integers, exact for any size
+                taps.first.push_back((2 * i + 1) * src / (2 * dst));
+                taps.weights.push_back(1);
+                break;
+            case ResampleFilter::BILINEAR: {
+                const double c = std::clamp(centre - 0.5, 0.0, last);
+                const auto i0 = static_cast<std::size_t>(c);
+                const double f = c - static_cast<double>(i0);
+                taps.first.push_back(i0);
+                taps.weights.push_back(static_cast<Acc>(1 - f));
+                if (i0 + 1 < src) taps.weights.push_back(static_cast<Acc>(f));
+                break;
+            }
+            case ResampleFilter::BOX: {
+                const double left = static_cast<double>(i) * ratio;
+                const double right = std::min(left + ratio, last + 1);
+                const auto j0 = static_cast<std::size_t>(left);
+                taps.first.push_back(j0);
+                for (std::size_t j{j0}; static_cast<double>(j) < right; j++) {
+                    const double overlap =
+                        std::min(right, static_cast<double>(j + 1)) -
+                        std::max(left, static_cast<double>(j));
+                    taps.weights.push_back(static_cast<Acc>(overlap / ratio));
+                }
+                break;
+            }
+        }
+        taps.offset.push_back(taps.weights.size());
+    }
+    return taps;
+}
+
+// Rounds an accumulated value back to the pixel type
+template <typename Pixel, typename Acc>
+Pixel to_pixel(const Acc v) {
+    if constexpr (std::is_integral_v<Pixel>) {
+        constexpr Acc lo = static_cast<Acc>(std::numeric_limits<Pixel>::min());
+        constexpr Acc hi = static_cast<Acc>(std::numeric_limits<Pixel>::max());
+        return static_cast<Pixel>(
+            std::clamp(std::floor(v + static_cast<Acc>(0.5)), lo, hi));
+    } else {
+        return static_cast<Pixel>(v);
+    }
+}
+
+// 8 and 16 bit pixels sum in float, wider ones in double
+template <typename Pixel>
+using accumulator_of = std::conditional_t<sizeof(Pixel) <= 2, float, double>;
+
+// acc += weight * row
+template <typename Pixel, typename Acc>
+void accumulate_row(std::span<Acc> acc, std::span<const Pixel> row,
+                    const Acc weight) {
+    if constexpr (std::same_as<Pixel, std::uint8_t> ||
+                  std::same_as<Pixel, std::int32_t>) {
+        accumulate(acc, row, weight);
+    } else {
+        for (std::size_t i{0}; i < acc.size(); i++) {
+            acc[i] += weight * static_cast<Acc>(row[i]);
+        }
+    }
+}
+
+}  // namespace detail
+
+// Resamples all of src into all of dst, whatever their sizes. dst must be
+// a different canvas.
+template <typename Pixel>
+void resample(const BasicCanvas<Pixel>& src, BasicCanvas<Pixel>& dst,
+              const ResampleFilter filter) {
+    using Acc = detail::accumulator_of<Pixel>;
+    const std::size_t sw = src.get_width(), sh = src.get_height();
+    const std::size_t dw = dst.get_width(), dh = dst.get_height();
+    if (&src == &dst || sw == 0 || sh == 0 || dw == 0 || dh == 0) return;
+    const auto columns = detail::make_taps<Acc>(sw, dw, filter);
+    const auto rows = detail::make_taps<Acc>(sh, dh, filter);
+
+    if (filter == ResampleFilter::NEAREST) {
+        // A gather, no arithmetic
+        for (std::size_t y{0}; y < dh; y++) {
+            const auto from = src.row(rows.first[y]);
+            const auto to = dst.row(y);
+            for (std::size_t x{0}; x < dw; x++) {
+                to[x] = from[columns.first[x]];
+            }
+        }
+        return;
+    }
+
+    // Only the source columns some output pixel reads are summed
+    const std::size_t x_begin = columns.first.front();
+    const std::size_t x_end = columns.first.back() + columns.count(dw - 1);
+    std::vector<Acc> acc(x_end - x_begin);
+    for (std::size_t y{0}; y < dh; y++) {
+        std::fill(acc.begin(), acc.end(), Acc{0});
+        const std::size_t y0 = rows.first[y];
+        for (std::size_t k{0}; k < rows.count(y); k++) {
+            detail::accumulate_row<Pixel, Acc>(
+                acc, src.row(y0 + k, x_begin, x_end),
+                rows.weights[rows.offset[y] + k]);
+        }
+        const auto to = dst.row(y);
+        for (std::size_t x{0}; x < dw; x++) {
+            const Acc* sum = acc.data() + (columns.first[x] - x_begin);
+            const Acc* weight = columns.weights.data() + columns.offset[x];
+            Acc v{0};
+            for (std::size_t k{0}; k < columns.count(x); k++) {
+                v += weight[k] * sum[k];
+            }
+            to[x] = detail::to_pixel<Pixel>(v);
+        }
+    }
+}
+
+// A w x h copy of src, resampled with filter
+template <typename Pixel>
+BasicCanvas<Pixel> scaled(const BasicCanvas<Pixel>& src, const std::size_t w,
+                          const std::size_t h, const ResampleFilter filter) {
+    BasicCanvas<Pixel> out(w, h);
+    resample(src, out, filter);
+    return out;
+}
+
+}  // namespace canvas_kernels
+
+#endif  // CANVAS_RESAMPLE_H
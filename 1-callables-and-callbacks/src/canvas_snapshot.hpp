@@ -0,0 +1,312 @@
+#ifndef CANVAS_SNAPSHOT_H
+#define CANVAS_SNAPSHOT_H
+
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <span>
+#include <streambuf>
+#include <type_traits>
+#include <vector>
+
+#include "canvas.hpp"
+
+// Binary canvas snapshots for handing canvases between pipeline stages.
+// Unlike CanvasEncoder's formats they round-trip every pixel exactly.
+//
+//   "CSNP" <version 1> <flags> <pixel bytes> <signed>
+//   <width varint> <height varint>
+//   then every row, top to bottom, as packets covering exactly width
+//   pixels:
+//     varint (n - 1) << 1      a run, one value repeated n times
+//     varint (n - 1) << 1 | 1  n literal values
+//
+// Varints are LEB128, 7 bits a byte, low bits first. A value is the pixel
+// zigzag encoded, so small negative pixels stay short. With the DELTA flag
+// the value is instead the pixel minus the previous frame's pixel, wrapping
+// in the pixel type, so unchanged areas become runs of zeros.
+//
+// Both ends stream. The encoder builds one row at a time in a reused
+// buffer and the decoder writes rows straight into the target canvas, a
+// delta onto the previous frame in place, so neither ever holds a second
+// copy of the canvas.
+namespace snapshot {
+
+enum class Flags : std::uint8_t { NONE = 0x00, DELTA = 0x01 };
+
+inline constexpr std::array<char, 4> magic{'C', 'S', 'N', 'P'};
+inline constexpr std::uint8_t version{1};
+
+// Shortest run worth a run packet, shorter ones join the literals around
+// them
+inline constexpr std::size_t min_run{3};
+
+// Pixel types a snapshot holds, plain integers
+template <typename Pixel>
+concept SnapshotPixel = std::integral<Pixel> && !std::same_as<Pixel, bool>;
+
+template <SnapshotPixel Pixel>
+constexpr std::uint64_t zigzag(const Pixel p) {
+    using Signed = std::make_signed_t<Pixel>;
+    const auto s = static_cast<std::int64_t>(static_cast<Signed>(p));
+    return static_cast<std::uint64_t>(s) << 1 ^
+           static_cast<std::uint64_t>(s >> 63);
+}
+
+template <SnapshotPixel Pixel>
+constexpr Pixel unzigzag(const std::uint64_t v) {
+    const auto s = static_cast<std::int64_t>(v >> 1) ^
+                   -static_cast<std::int64_t>(v & 1);
+    return static_cast<Pixel>(s);
+}
+
+// Wrapping difference and sum in the pixel type, signed pixels included
+template <SnapshotPixel Pixel>
+constexpr Pixel wrap_sub(const Pixel a, const Pixel b) {
+    using Unsigned = std::make_unsigned_t<Pixel>;
+    return static_cast<Pixel>(
+        static_cast<Unsigned>(static_cast<Unsigned>(a) -
+                              static_cast<Unsigned>(b)));
+}
+
+template <SnapshotPixel Pixel>
+constexpr Pixel wrap_add(const Pixel a, const Pixel b) {
+    using Unsigned = std::make_unsigned_t<Pixel>;
+    return static_cast<Pixel>(
+        static_cast<Unsigned>(static_cast<Unsigned>(a) +
+                              static_cast<Unsigned>(b)));
+}
+
+}  // namespace snapshot
+
+// Writes snapshots to a stream. Reusing one encoder across frames keeps
+// its row buffer, so steady state encoding does not allocate.
+class SnapshotEncoder {
+   public:
+    // A whole frame. Returns false if the stream failed.
+    template <snapshot::SnapshotPixel Pixel>
+    bool write(const BasicCanvas<Pixel>& cv, std::ostream& out) {
+        return write_rows<Pixel>(cv, nullptr, out);
+    }
+
+    // The changes from previous, which must have the same size. Returns
+    // false, writing nothing, when it does not, or if the stream failed.
+    template <snapshot::SnapshotPixel Pixel>
+    bool write_delta(const BasicCanvas<Pixel>& cv,
+                     const BasicCanvas<Pixel>& previous, std::ostream& out) {
+        if (previous.get_width() != cv.get_width() ||
+            previous.get_height() != cv.get_height())
+            return false;
+        return write_rows(cv, &previous, out);
+    }
+
+    // Bytes written by the last write
+    std::size_t size() const { return written; }
+
+   private:
+    std::vector<char> buffer;
+    std::size_t written{0};
+
+    void put(const std::uint8_t byte) {
+        buffer.push_back(static_cast<char>(byte));
+    }
+    void put_varint(std::uint64_t v) {
+        while (v >= 0x80) {
+            put(static_cast<std::uint8_t>(v | 0x80));
+            v >>= 7;
+        }
+        put(static_cast<std::uint8_t>(v));
+    }
+
+    bool flush(std::ostream& out) {
+        out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        written += buffer.size();
+        buffer.clear();
+        return static_cast<bool>(out);
+    }
+
+    template <typename Pixel>
+    bool write_rows(const BasicCanvas<Pixel>& cv,
+                    const BasicCanvas<Pixel>* previous, std::ostream& out) {
+        written = 0;
+        buffer.clear();
+        for (const char c : snapshot::magic) {
+            put(static_cast<std::uint8_t>(c));
+        }
+        put(snapshot::version);
+        put(static_cast<std::uint8_t>(previous != nullptr
+                                          ? snapshot::Flags::DELTA
+                                          : snapshot::Flags::NONE));
+        put(sizeof(Pixel));
+        put(std::is_signed_v<Pixel> ? 1 : 0);
+        put_varint(cv.get_width());
+        put_varint(cv.get_height());
+        if (!flush(out)) return false;
+        for (std::size_t y{0}; y < cv.get_height(); y++) {
+            if (previous != nullptr)
+                encode_row<true>(cv.row(y), previous->row(y));
+            else
+                encode_row<false>(cv.row(y), {});
+            if (!flush(out)) return false;
+        }
+        return true;
+    }
+
+    // Packets for one row, of its differences from previous for a delta
+    template <bool Delta, typename Pixel>
+    void encode_row(std::span<const Pixel> row,
+                    std::span<const Pixel> previous) {
+        const auto value = [&](const std::size_t x) {
+            if constexpr (Delta)
+                return snapshot::wrap_sub(row[x], previous[x]);
+            else
+                return row[x];
+        };
+        const auto literals = [&](const std::size_t begin,
+                                  const std::size_t end) {
+            if (begin == end) return;
+            put_varint((end - begin - 1) << 1 | 1);
+            for (std::size_t x{begin}; x < end; x++) {
+                put_varint(snapshot::zigzag(value(x)));
+            }
+        };
+        std::size_t pending{0};  // first pixel not yet in a packet
+        std::size_t x{0};
+        while (x < row.size()) {
+            const Pixel v = value(x);
+            std::size_t end{x + 1};
+            while (end < row.size() && value(end) == v) end++;
+            if (end - x >= snapshot::min_run) {
+                literals(pending, x);
+                put_varint((end - x - 1) << 1);
+                put_varint(snapshot::zigzag(v));
+                pending = end;
+            }
+            x = end;
+        }
+        literals(pending, row.size());
+    }
+};
+
+// Reads snapshots from a stream into a canvas
+class SnapshotDecoder {
+   public:
+    // A whole frame resizes cv to the snapshot's size. A delta is applied
+    // to cv in place, which must hold the frame it was taken against, and
+    // only marks the pixels it changes dirty. Returns false on a malformed
+    // or truncated snapshot, a pixel type other than cv's or a delta of a
+    // different size. cv may be partly updated after a failure part way.
+    template <snapshot::SnapshotPixel Pixel>
+    bool read(std::istream& in, BasicCanvas<Pixel>& cv) {
+        std::streambuf* const source = in.rdbuf();
+        if (source == nullptr) return false;
+        src = source;
+        const bool ok = read_frame(cv);
+        if (!ok) in.setstate(std::ios::failbit);
+        src = nullptr;
+        return ok;
+    }
+
+   private:
+    std::streambuf* src{nullptr};
+
+    bool get(std::uint8_t& byte) {
+        const auto c = src->sbumpc();
+        if (c == std::streambuf::traits_type::eof()) return false;
+        byte = static_cast<std::uint8_t>(c);
+        return true;
+    }
+    bool get_varint(std::uint64_t& v) {
+        v = 0;
+        for (unsigned shift{0}; shift < 64; shift += 7) {
+            std::uint8_t byte{0};
+            if (!get(byte)) return false;
+            v |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) return true;
+        }
+        return false;
+    }
+
+    template <typename Pixel>
+    bool read_frame(BasicCanvas<Pixel>& cv) {
+        std::array<char, 4> tag{};
+        for (char& c : tag) {
+            std::uint8_t byte{0};
+            if (!get(byte)) return false;
+            c = static_cast<char>(byte);
+        }
+        std::uint8_t header[4]{};
+        for (std::uint8_t& byte : header) {
+            if (!get(byte)) return false;
+        }
+        std::uint64_t w{0}, h{0};
+        if (tag != snapshot::magic || header[0] != snapshot::version ||
+            header[1] > static_cast<std::uint8_t>(snapshot::Flags::DELTA) ||
+            header[2] != sizeof(Pixel) ||
+            header[3] != (std::is_signed_v<Pixel> ? 1 : 0) ||
+            !get_varint(w) || !get_varint(h))
+            return false;
+        const bool delta =
+            header[1] == static_cast<std::uint8_t>(snapshot::Flags::DELTA);
+        if (delta) {
+            if (w != cv.get_width() || h != cv.get_height()) return false;
+        } else if (w != cv.get_width() || h != cv.get_height()) {
+            if (w != 0 && h > SIZE_MAX / w) return false;
+            if (!cv.resize(w, h)) return false;
+        }
+        for (std::size_t y{0}; y < h; y++) {
+            if (!read_row(cv, y, delta)) return false;
+        }
+        return true;
+    }
+
+    template <typename Pixel>
+    bool read_row(BasicCanvas<Pixel>& cv, const std::size_t y,
+                  const bool delta) {
+        const std::size_t w = cv.get_width();
+        // A whole frame rewrites the row, a delta only touches, and marks
+        // dirty, the pixels it changes
+        const std::span<Pixel> line =
+            delta ? std::span<Pixel>{} : cv.row(y);
+        std::size_t x{0};
+        while (x < w) {
+            std::uint64_t packet{0};
+            if (!get_varint(packet)) return false;
+            const std::uint64_t n = (packet >> 1) + 1;
+            if (n > w - x) return false;
+            const auto end = x + static_cast<std::size_t>(n);
+            std::uint64_t v{0};
+            if ((packet & 1) == 0) {
+                if (!get_varint(v)) return false;
+                const auto p = snapshot::unzigzag<Pixel>(v);
+                if (!delta) {
+                    std::fill(line.begin() + x, line.begin() + end, p);
+                } else if (p != Pixel{0}) {
+                    for (Pixel& px : cv.row(y, x, end)) {
+                        px = snapshot::wrap_add(px, p);
+                    }
+                }
+                x = end;
+                continue;
+            }
+            for (; x < end; x++) {
+                if (!get_varint(v)) return false;
+                const auto p = snapshot::unzigzag<Pixel>(v);
+                if (!delta) {
+                    line[x] = p;
+                } else if (p != Pixel{0}) {
+                    Pixel& px = cv.at(x, y);
+                    px = snapshot::wrap_add(px, p);
+                    cv.mark_dirty(y, x, x + 1);
+                }
+            }
+        }
+        return true;
+    }
+};
+
+#endif  // CANVAS_SNAPSHOT_H
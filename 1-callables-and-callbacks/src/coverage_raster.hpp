@@ -0,0 +1,365 @@
+#ifndef COVERAGE_RASTER_H
+#define COVERAGE_RASTER_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include "canvas.hpp"
+#include "canvas_kernels.hpp"
+#include "ellipse_raster.hpp"
+#include "geometry.hpp"
+#include "line_raster.hpp"
+#include "scanline_fill.hpp"
+#include "shape_raster.hpp"
+
+// Anti-aliased rendering into an 8 bit coverage (alpha) canvas.
+// Instead of setting a pixel or leaving it, these rasterizers write how much
+// of each pixel the shape covers, 0 to 255:
+//   lines     Wu's algorithm, each step splits one pixel of coverage
+//             between the two pixels either side of the exact position
+//   circles   analytic, a one pixel wide ramp across the edge measured
+//             from the pixel centre
+//   polygons  filled with 4 or 16 sparse samples per pixel, outlines are
+//             Wu lines along the edges
+// Coverage combines with max, so pixels touched twice keep their highest
+// coverage instead of saturating. The finished alpha canvas is then blended
+// onto a colour canvas with canvas_kernels::composite.
+// As with the binary rasterizers every pixel only depends on its own
+// position, so clipped and tiled drawing match unclipped drawing exactly.
+namespace coverage {
+
+enum class Samples : std::uint8_t { X4 = 4, X16 = 16 };
+
+// Sample position relative to the pixel centre, in 1/16ths of a pixel
+struct SampleOffset {
+    int x{0}, y{0};
+};
+
+// Sparse patterns: no two samples share a row or a column, so near
+// horizontal and near vertical edges both get the full number of levels
+constexpr std::array<SampleOffset, 4> pattern_4{
+    {{-2, -6}, {6, -2}, {-6, 2}, {2, 6}}};
+constexpr std::array<SampleOffset, 16> pattern_16{
+    {{1, 1},
+     {-1, -3},
+     {-3, 2},
+     {4, -1},
+     {-5, -2},
+     {2, 5},
+     {5, 3},
+     {3, -5},
+     {-2, 6},
+     {0, -7},
+     {-4, -6},
+     {-6, 4},
+     {-8, 0},
+     {7, -4},
+     {6, 7},
+     {-7, -8}}};
+
+inline std::span<const SampleOffset> pattern(const Samples samples) {
+    if (samples == Samples::X16) return pattern_16;
+    return pattern_4;
+}
+
+// Columns handled per pass of the polygon sampler
+constexpr int chunk_width{256};
+
+inline std::uint8_t to_alpha(const double c) {
+    return static_cast<std::uint8_t>(
+        std::lround(std::clamp(c, 0.0, 1.0) * 255));
+}
+
+// Keeps the higher of the current and the new coverage of (x, y). Not
+// tracked, callers mark what they plotted.
+inline void plot(Canvas8& alpha, const int x, const int y,
+                 const std::uint8_t a) {
+    auto& p = alpha.at(x, y);
+    if (p < a) p = a;
+}
+
+// Wu line between the pixel centres a and b
+inline void line(Canvas8& alpha, const Point a, const Point b,
+                 const Rect& clip) {
+    using namespace line_detail;
+    using scanline::one;
+    const Rect area = clip.intersect(canvas_rect(alpha));
+    if (area.empty()) return;
+
+    const std::int64_t dx = std::int64_t{b.x} - a.x;
+    const std::int64_t dy = std::int64_t{b.y} - a.y;
+    const bool x_major = std::abs(dx) >= std::abs(dy);
+    const std::int64_t d_major = x_major ? dx : dy;
+    const std::int64_t d_minor = x_major ? dy : dx;
+    const std::int64_t length = std::abs(d_major);
+    const int s = d_major >= 0 ? 1 : -1;
+    const int major0 = x_major ? a.x : a.y;
+    const int minor0 = x_major ? a.y : a.x;
+
+    auto put = [&](const int major, const int minor, const std::uint8_t c) {
+        const int x = x_major ? major : minor;
+        const int y = x_major ? minor : major;
+        if (c != 0 && area.contains(x, y)) plot(alpha, x, y, c);
+    };
+
+    // only the steps inside the clip along the major axis are walked
+    const StepRange steps =
+        x_major ? axis_steps(a.x, s, area.x0, area.x1 - 1, length)
+                : axis_steps(a.y, s, area.y0, area.y1 - 1, length);
+    // exact minor position of step i, rounded to fixed point. The offset
+    // can need more than 64 bits on long lines, mul_add_div() handles it.
+    auto position = [&](const std::int64_t i) {
+        const std::int64_t pos = minor0 * one;
+        if (length == 0) return pos;
+        const std::int64_t step = 2 * std::abs(d_minor) * one;
+        if (d_minor >= 0)
+            return pos + mul_add_div(i, step, length, 2 * length).quot;
+        return pos - mul_add_div(i, step, length - 1, 2 * length).quot;
+    };
+    auto major_at = [&](const std::int64_t i) {
+        return static_cast<int>(major0 + s * i);
+    };
+    for (std::int64_t i{steps.first}; i <= steps.last; i++) {
+        const std::int64_t pos = position(i);
+        const int minor = scanline::floor_fx(pos);
+        const std::int64_t frac = pos & (one - 1);
+        const auto weight = static_cast<std::uint8_t>(
+            ((one - frac) * 255 + scanline::half) >> scanline::frac_bits);
+        const int major = major_at(i);
+        put(major, minor, weight);
+        // the pixel past INT_MAX lies outside the canvas
+        if (minor < std::numeric_limits<int>::max())
+            put(major, minor + 1, static_cast<std::uint8_t>(255 - weight));
+    }
+    if (steps.first > steps.last) return;
+
+    // the minor position only moves one way, so the end steps bound every
+    // plotted pixel
+    const int major_a = major_at(steps.first);
+    const int major_b = major_at(steps.last);
+    const int minor_a = scanline::floor_fx(position(steps.first));
+    const int minor_b = scanline::floor_fx(position(steps.last));
+    const int major_lo = std::min(major_a, major_b);
+    const std::int64_t major_hi = std::int64_t{std::max(major_a, major_b)} + 1;
+    const int minor_lo = std::min(minor_a, minor_b);
+    const std::int64_t minor_hi = std::int64_t{std::max(minor_a, minor_b)} + 2;
+    const Rect box =
+        x_major ? clamped_rect(major_lo, minor_lo, major_hi, minor_hi)
+                : clamped_rect(minor_lo, major_lo, minor_hi, major_hi);
+    mark_written(alpha, box.intersect(area));
+}
+
+// Coverage of the pixel at offset (x, d) from the centre by the filled
+// ellipse with semi-axes a and b. Circles use the exact distance to the
+// edge, ellipses the first order estimate g / |grad g|.
+inline double fill_coverage(const double x, const double d, const double a,
+                            const double b) {
+    if (a <= 0 || b <= 0) return 0;
+    if (a == b) return std::clamp(a - std::hypot(x, d) + 0.5, 0.0, 1.0);
+    const double a2 = a * a, b2 = b * b;
+    const double g = x * x / a2 + d * d / b2 - 1;
+    const double grad = 2 * std::sqrt(x * x / (a2 * a2) + d * d / (b2 * b2));
+    if (grad == 0) return 1;
+    return std::clamp(0.5 - g / grad, 0.0, 1.0);
+}
+
+// Circles and ellipses with the radii of rasterize_ellipse. Filled shapes
+// cover up to half a pixel past the radius, outlines are the one pixel
+// band between half a pixel inside and half a pixel outside it.
+inline void ellipse(Canvas8& alpha, const Point centre, int rx, int ry,
+                    const PolygonMode mode, const Rect& clip) {
+    rx = std::max(rx, 0);
+    ry = std::max(ry, 0);
+    const Rect box{centre.x - rx, centre.y - ry, centre.x + rx + 1,
+                   centre.y + ry + 1};
+    const Rect area = clip.intersect(canvas_rect(alpha)).intersect(box);
+    if (area.empty()) return;
+
+    const bool filled = mode == PolygonMode::FILLED;
+    const double ax = rx + 0.5, ay = ry + 0.5;
+    // pixels this far inside the edge are solid when filled and untouched
+    // in an outline, so only the ring around the edge is evaluated
+    const int depth = filled ? 1 : 2;
+    const bool has_core = rx >= depth && ry >= depth;
+    const EllipseRows core{rx - depth, ry - depth};
+
+    for (int y{area.y0}; y < area.y1; y++) {
+        const int d = y - centre.y;
+        const int inner = has_core ? core.half_width(d) : -1;
+        if (filled && inner >= 0) {
+            scanline::span(alpha, area, y, centre.x - inner, centre.x + inner,
+                           std::uint8_t{255});
+        }
+        auto edge = [&](const int first, const int last) {
+            for (int x{std::max(first, area.x0)};
+                 x <= std::min(last, area.x1 - 1); x++) {
+                const double off = x - centre.x;
+                double c = fill_coverage(off, d, ax, ay);
+                if (!filled) c -= fill_coverage(off, d, ax - 1, ay - 1);
+                const auto a = to_alpha(c);
+                if (a != 0) plot(alpha, x, y, a);
+            }
+        };
+        if (inner < 0) {
+            edge(centre.x - rx, centre.x + rx);
+        } else {
+            edge(centre.x - rx, centre.x - inner - 1);
+            edge(centre.x + inner + 1, centre.x + rx);
+        }
+    }
+    mark_written(alpha, area);
+}
+
+// Sorted x crossings, in fixed point, of the polygon's edges with the
+// horizontal line at fixed point height ys. Edges cover [top, bottom) so a
+// vertex shared by two edges is only counted once.
+inline std::size_t crossings_at(std::span<const Point> vertices,
+                                const std::int64_t ys,
+                                std::span<std::int64_t> out) {
+    using scanline::one;
+    std::size_t n{0};
+    for (std::size_t i{0}; i < vertices.size(); i++) {
+        Point a = vertices[i];
+        Point b = vertices[(i + 1) % vertices.size()];
+        if (a.y == b.y) continue;
+        if (b.y < a.y) std::swap(a, b);
+        const std::int64_t top = a.y * one;
+        if (ys < top || ys >= b.y * one) continue;
+        out[n++] = a.x * one + (ys - top) * (b.x - a.x) / (b.y - a.y);
+    }
+    std::sort(out.begin(), out.begin() + n);
+    return n;
+}
+
+// Even-odd fill, each pixel covered by the fraction of its samples inside.
+// crossings has room for vertices.size() crossings per sample.
+inline void fill_samples(Canvas8& alpha, std::span<const Point> vertices,
+                         const Samples samples, const Rect& area,
+                         std::span<std::int64_t> crossings) {
+    using scanline::one;
+    const auto offsets = pattern(samples);
+    const std::size_t per_sample = vertices.size();
+    const auto count = static_cast<int>(offsets.size());
+    std::array<std::size_t, pattern_16.size()> found{};
+    std::array<std::int16_t, chunk_width + 1> hits;
+    std::array<std::uint8_t, chunk_width> row_alpha;
+
+    for (int y{area.y0}; y < area.y1; y++) {
+        bool any{false};
+        for (std::size_t s{0}; s < offsets.size(); s++) {
+            const std::int64_t ys = y * one + offsets[s].y * (one / 16);
+            found[s] = crossings_at(
+                vertices, ys, crossings.subspan(s * per_sample, per_sample));
+            any = any || found[s] != 0;
+        }
+        if (!any) continue;
+
+        for (int x0{area.x0}; x0 < area.x1; x0 += chunk_width) {
+            const int x1 = std::min(x0 + chunk_width, area.x1);
+            const auto w = static_cast<std::size_t>(x1 - x0);
+            std::fill(hits.begin(), hits.begin() + w + 1, std::int16_t{0});
+            // every inside run of every sample row becomes +1 / -1 marks
+            for (std::size_t s{0}; s < offsets.size(); s++) {
+                const std::int64_t ox = offsets[s].x * (one / 16);
+                const auto* c = crossings.data() + s * per_sample;
+                for (std::size_t i{0}; i + 1 < found[s]; i += 2) {
+                    const int first =
+                        std::clamp(scanline::ceil_fx(c[i] - ox), x0, x1);
+                    const int end =
+                        std::clamp(scanline::ceil_fx(c[i + 1] - ox), x0, x1);
+                    if (first >= end) continue;
+                    hits[first - x0]++;
+                    hits[end - x0]--;
+                }
+            }
+            int inside{0};
+            for (std::size_t i{0}; i < w; i++) {
+                inside += hits[i];
+                row_alpha[i] = static_cast<std::uint8_t>(
+                    (inside * 255 + count / 2) / count);
+            }
+            canvas_kernels::max_coverage(alpha.row(y, x0, x1), row_alpha);
+        }
+    }
+}
+
+// Filled polygons are sampled, outlines are Wu lines along every edge
+inline void polygon(Canvas8& alpha, std::span<const Point> vertices,
+                    const PolygonMode mode, const Samples samples,
+                    const Rect& clip) {
+    const Rect area =
+        clip.intersect(canvas_rect(alpha)).intersect(polygon_bounds(vertices));
+    if (area.empty()) return;
+
+    const std::size_t n = vertices.size();
+    if (mode == PolygonMode::OUTLINE) {
+        for (std::size_t i{0}; i < n; i++) {
+            line(alpha, vertices[i], vertices[(i + 1) % n], area);
+        }
+        return;
+    }
+    if (n <= scanline::inline_vertices) {
+        std::array<std::int64_t, scanline::inline_vertices * pattern_16.size()>
+            crossings;
+        fill_samples(alpha, vertices, samples, area, crossings);
+    } else {
+        std::vector<std::int64_t> crossings(n * pattern_16.size());
+        fill_samples(alpha, vertices, samples, area, crossings);
+    }
+}
+
+}  // namespace coverage
+
+// Coverage counterpart of rasterize(): adds cmd's coverage to alpha inside
+// clip. The command's colour is not used, it is applied when compositing.
+// Squares and points are already pixel aligned and are drawn solid.
+inline void rasterize_coverage(
+    Canvas8& alpha, const DrawCommand& cmd, const Rect& clip,
+    const coverage::Samples samples = coverage::Samples::X4) {
+    const Rect area = clip.intersect(canvas_rect(alpha)).intersect(bounds(cmd));
+    if (area.empty()) return;
+
+    switch (cmd.shape) {
+        case Shape::SQUARE:
+        case Shape::POINT: {
+            DrawCommand solid = cmd;
+            solid.colour = 255;
+            rasterize(alpha, solid, area);
+            break;
+        }
+        case Shape::CIRCLE:
+        case Shape::CIRCLE_V2:
+            coverage::ellipse(alpha, {cmd.x0, cmd.y0}, cmd.x1,
+                              cmd.y1 > 0 ? cmd.y1 : cmd.x1, cmd.mode, area);
+            break;
+        case Shape::TRIANGLE:
+        case Shape::TRAPEZIUM:
+        case Shape::POLYGON:
+        case Shape::RHOMBUS:
+        case Shape::KITE: {
+            std::array<Point, max_polygon_sides> vertices;
+            const auto n = shape_vertices(cmd, vertices);
+            coverage::polygon(alpha, std::span<const Point>(vertices.data(), n),
+                              cmd.mode, samples, area);
+            break;
+        }
+        case Shape::LINE:
+            coverage::line(alpha, {cmd.x0, cmd.y0}, {cmd.x1, cmd.y1}, area);
+            break;
+    }
+}
+
+inline void rasterize_coverage(
+    Canvas8& alpha, const DrawCommand& cmd,
+    const coverage::Samples samples = coverage::Samples::X4) {
+    rasterize_coverage(alpha, cmd, canvas_rect(alpha), samples);
+}
+
+#endif  // COVERAGE_RASTER_H
@@ -0,0 +1,257 @@
+#ifndef DRAW_LIST_H
+#define DRAW_LIST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "affine_transform.hpp"
+#include "canvas.hpp"
+#include "coverage_raster.hpp"
+#include "shape_raster.hpp"
+#include "work_stealing_pool.hpp"
+
+// A command buffer of shapes rasterized together in one pass.
+// Commands are binned by the screen region (tile) they overlap, then each
+// tile is drawn in turn with every command clipped to it. A tile is small
+// enough to stay in cache while all of its shapes are drawn, so the canvas
+// is streamed through once rather than once per shape. Commands keep their
+// recorded order inside a tile, so overlapping shapes resolve exactly as
+// they would when drawn one after another.
+//
+// rasterize() uses full width bands of rows on the calling thread.
+// rasterize_tiled() uses square tiles spread over a WorkStealingPool; tiles
+// never share a pixel, so the output is identical to the serial path.
+// The _coverage variants draw anti-aliased coverage into an alpha canvas
+// instead, see coverage_raster.hpp.
+// A command can be pushed with an Affine placement, see
+// affine_transform.hpp. Lists that never get one keep no placements at
+// all.
+class DrawList {
+   public:
+    static constexpr std::size_t default_band_height{64};
+    static constexpr std::size_t default_tile_size{64};
+
+    void push(const DrawCommand& cmd) {
+        commands.push_back(cmd);
+        if (!placements.empty()) placements.emplace_back();
+    }
+    // cmd drawn placed by m
+    void push(const DrawCommand& cmd, const Affine& m) {
+        if (placements.empty()) {
+            if (m.is_identity()) {
+                commands.push_back(cmd);
+                return;
+            }
+            placements.resize(commands.size());
+        }
+        commands.push_back(cmd);
+        placements.push_back(m);
+    }
+    void clear() {
+        commands.clear();
+        placements.clear();
+    }
+    void reserve(const std::size_t n) { commands.reserve(n); }
+
+    std::size_t size() const { return commands.size(); }
+    bool empty() const { return commands.empty(); }
+    std::span<const DrawCommand> view() const { return commands; }
+
+    template <PixelSurface Surface>
+    void rasterize(Surface& cv,
+                   const std::size_t band_height = default_band_height) {
+        const Rect full = canvas_rect(cv);
+        if (full.empty() || commands.empty()) return;
+        bin(full, full.x1, clamp_extent(band_height));
+
+        for (std::size_t t{0}; t < tile_count(); t++) {
+            for_each_in_tile(t, [&](const std::uint32_t i, const Rect& clip) {
+                draw(cv, i, clip);
+            });
+        }
+    }
+
+    template <typename Pixel>
+    void rasterize_tiled(BasicCanvas<Pixel>& cv, WorkStealingPool& pool,
+                         const std::size_t tile_size = default_tile_size) {
+        const Rect full = canvas_rect(cv);
+        if (full.empty() || commands.empty()) return;
+        // columns sharing storage stay in one tile
+        const int tile = clamp_extent(tile_size);
+        const int align = clamp_extent(BasicCanvas<Pixel>::column_alignment);
+        bin(full, (tile + align - 1) / align * align, tile);
+
+        const UntrackedWrites untracked{cv, *this};
+        pool.parallel_for(tile_count(), [this, &cv](const std::size_t t) {
+            for_each_in_tile(t, [&](const std::uint32_t i, const Rect& clip) {
+                draw(cv, i, clip);
+            });
+        });
+    }
+
+    void rasterize_coverage(
+        Canvas8& alpha,
+        const coverage::Samples samples = coverage::Samples::X4,
+        const std::size_t band_height = default_band_height) {
+        const Rect full = canvas_rect(alpha);
+        if (full.empty() || commands.empty()) return;
+        bin(full, full.x1, clamp_extent(band_height));
+
+        for (std::size_t t{0}; t < tile_count(); t++) {
+            for_each_in_tile(t, [&](const std::uint32_t i, const Rect& clip) {
+                draw_coverage(alpha, i, clip, samples);
+            });
+        }
+    }
+
+    void rasterize_coverage_tiled(
+        Canvas8& alpha, WorkStealingPool& pool,
+        const coverage::Samples samples = coverage::Samples::X4,
+        const std::size_t tile_size = default_tile_size) {
+        const Rect full = canvas_rect(alpha);
+        if (full.empty() || commands.empty()) return;
+        const int tile = clamp_extent(tile_size);
+        bin(full, tile, tile);
+
+        const UntrackedWrites untracked{alpha, *this};
+        pool.parallel_for(tile_count(), [&](const std::size_t t) {
+            for_each_in_tile(t, [&](const std::uint32_t i, const Rect& clip) {
+                draw_coverage(alpha, i, clip, samples);
+            });
+        });
+    }
+
+   private:
+    std::vector<DrawCommand> commands;
+    // Empty, or the placement of every command
+    std::vector<Affine> placements;
+
+    // Current tile grid
+    Rect grid_area;
+    int tile_w{1}, tile_h{1}, tile_cols{0}, tile_rows{0};
+
+    // Bins as a compressed table: the commands of tile t are
+    // bin_items[bin_offsets[t]] .. bin_items[bin_offsets[t + 1] - 1].
+    // Kept between frames so steady state rendering does not allocate.
+    std::vector<std::uint32_t> bin_offsets;
+    std::vector<std::uint32_t> bin_items;
+    std::vector<std::uint32_t> bin_cursor;
+
+    static int clamp_extent(const std::size_t extent) {
+        return extent == 0 ? 1 : static_cast<int>(extent);
+    }
+
+    std::size_t tile_count() const { return bin_offsets.size() - 1; }
+
+    bool is_placed(const std::uint32_t i) const {
+        return !placements.empty() && !placements[i].is_identity();
+    }
+
+    Rect command_bounds(const std::uint32_t i) const {
+        return is_placed(i) ? ::bounds(commands[i], placements[i])
+                            : ::bounds(commands[i]);
+    }
+
+    template <PixelSurface Surface>
+    void draw(Surface& cv, const std::uint32_t i, const Rect& clip) const {
+        if (is_placed(i))
+            ::rasterize(cv, commands[i], placements[i], clip);
+        else
+            ::rasterize(cv, commands[i], clip);
+    }
+
+    void draw_coverage(Canvas8& alpha, const std::uint32_t i,
+                       const Rect& clip,
+                       const coverage::Samples samples) const {
+        if (is_placed(i))
+            ::rasterize_coverage(alpha, commands[i], placements[i], clip,
+                                 samples);
+        else
+            ::rasterize_coverage(alpha, commands[i], clip, samples);
+    }
+
+    Rect tile_rect(const std::size_t t) const {
+        const int col = static_cast<int>(t) % tile_cols;
+        const int row = static_cast<int>(t) / tile_cols;
+        const Rect tile{col * tile_w, row * tile_h, (col + 1) * tile_w,
+                        (row + 1) * tile_h};
+        return tile.intersect(grid_area);
+    }
+
+    // Tiles on different threads share rows, so a tiled pass marks every
+    // command's bounds dirty up front and pauses the canvas' own tracking
+    // until the pass is over
+    template <typename Pixel>
+    class UntrackedWrites {
+       public:
+        UntrackedWrites(BasicCanvas<Pixel>& cv, const DrawList& list)
+            : canvas{cv}, was_tracking{cv.is_dirty_tracking()} {
+            const Rect full = canvas_rect(cv);
+            for (std::uint32_t i{0}; i < list.commands.size(); i++) {
+                const Rect area = list.command_bounds(i).intersect(full);
+                for (int y{area.y0}; y < area.y1; y++) {
+                    cv.mark_dirty(y, area.x0, area.x1);
+                }
+            }
+            cv.set_dirty_tracking(false);
+        }
+        ~UntrackedWrites() { canvas.set_dirty_tracking(was_tracking); }
+        UntrackedWrites(const UntrackedWrites&) = delete;
+        UntrackedWrites& operator=(const UntrackedWrites&) = delete;
+
+       private:
+        BasicCanvas<Pixel>& canvas;
+        bool was_tracking;
+    };
+
+    // Calls draw(i, clip) for the commands i of tile t in record order
+    template <typename Draw>
+    void for_each_in_tile(const std::size_t t, Draw&& draw) const {
+        const Rect clip = tile_rect(t);
+        for (std::uint32_t i{bin_offsets[t]}; i < bin_offsets[t + 1]; i++) {
+            draw(bin_items[i], clip);
+        }
+    }
+
+    // Counting sort of command indices by tile, stable in record order
+    void bin(const Rect& full, const int w, const int h) {
+        grid_area = full;
+        tile_w = w;
+        tile_h = h;
+        tile_cols = (full.x1 + w - 1) / w;
+        tile_rows = (full.y1 + h - 1) / h;
+        const auto tiles = static_cast<std::size_t>(tile_cols * tile_rows);
+        bin_offsets.assign(tiles + 1, 0);
+
+        // Calls fn(t) for every tile command i overlaps
+        auto for_each_tile = [&](const std::uint32_t i, auto&& fn) {
+            const Rect area = command_bounds(i).intersect(full);
+            if (area.empty()) return;
+            for (int row{area.y0 / h}; row <= (area.y1 - 1) / h; row++) {
+                for (int col{area.x0 / w}; col <= (area.x1 - 1) / w; col++) {
+                    fn(static_cast<std::size_t>(row * tile_cols + col));
+                }
+            }
+        };
+
+        for (std::uint32_t i{0}; i < commands.size(); i++) {
+            for_each_tile(i,
+                          [&](const std::size_t t) { bin_offsets[t + 1]++; });
+        }
+        for (std::size_t t{0}; t < tiles; t++) {
+            bin_offsets[t + 1] += bin_offsets[t];
+        }
+
+        bin_items.resize(bin_offsets[tiles]);
+        bin_cursor.assign(bin_offsets.begin(), bin_offsets.end() - 1);
+        for (std::uint32_t i{0}; i < commands.size(); i++) {
+            for_each_tile(i, [&](const std::size_t t) {
+                bin_items[bin_cursor[t]++] = i;
+            });
+        }
+    }
+};
+
+#endif  // DRAW_LIST_H
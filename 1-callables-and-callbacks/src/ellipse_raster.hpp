@@ -0,0 +1,121 @@
+#ifndef ELLIPSE_RASTER_H
+#define ELLIPSE_RASTER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+
+#include "canvas.hpp"
+#include "geometry.hpp"
+#include "scanline_fill.hpp"
+
+// Integer midpoint circles and ellipses, produced one row at a time.
+// A pixel (x, d) relative to the centre is inside when it lies within the
+// ellipse whose semi-axes are half a pixel longer than rx and ry, i.e.
+//   (2x)^2 (2ry + 1)^2 + (2d)^2 (2rx + 1)^2 <= (2rx + 1)^2 (2ry + 1)^2
+// which for a circle is x^2 + d^2 <= r^2 + r, the midpoint criterion.
+// half_width(d) is the largest such x, found with a floating point square
+// root and then corrected with the exact integer test.
+//   filled   row d is the span [-half_width(d), half_width(d)]
+//   outline  row d keeps the pixels not already covered by the next row
+//            out, [half_width(|d| + 1) + 1, half_width(d)] on each side,
+//            which gives a connected one pixel ring
+// Rows outside the clip rectangle are never visited, and every row only
+// depends on d, so clipped drawing matches unclipped drawing exactly.
+// Circles take any int radius. Ellipses with unequal radii are evaluated in
+// 64 bit integers and support radii up to 16383. Everything is constexpr,
+// so sprite tables can be traced at compile time (shape_sprites.hpp).
+class EllipseRows {
+   public:
+    constexpr EllipseRows(const int radius_x, const int radius_y)
+        : rx{std::max(radius_x, 0)},
+          ry{std::max(radius_y, 0)},
+          ax{2 * static_cast<std::uint64_t>(rx) + 1},
+          ay{2 * static_cast<std::uint64_t>(ry) + 1} {}
+
+    constexpr int radius_x() const { return rx; }
+    constexpr int radius_y() const { return ry; }
+
+    // Largest x inside on row d, -1 when the row misses the ellipse
+    constexpr int half_width(int d) const {
+        d = d < 0 ? -d : d;
+        if (d > ry) return -1;
+        // The square root is not constexpr, at compile time the exact test
+        // walks out from the centre instead
+        int x{0};
+        if (!std::is_constant_evaluated()) x = estimate(d);
+        while (x < rx && inside(x + 1, d)) x++;
+        while (x > 0 && !inside(x, d)) x--;
+        return x;
+    }
+
+   private:
+    int rx, ry;
+    std::uint64_t ax, ay;  // 2r + 1
+
+    int estimate(const int d) const {
+        const double t = static_cast<double>(2 * d) / static_cast<double>(ay);
+        const double x =
+            (static_cast<double>(ax) * std::sqrt(std::max(0.0, 1.0 - t * t)) -
+             1.0) /
+            2.0;
+        return static_cast<int>(std::clamp(x, 0.0, double(rx)));
+    }
+
+    constexpr bool inside(const int x, const int d) const {
+        if (rx == ry) {
+            const auto r = static_cast<std::uint64_t>(rx);
+            const auto ux = static_cast<std::uint64_t>(x);
+            const auto ud = static_cast<std::uint64_t>(d);
+            return ux * ux + ud * ud <= r * r + r;
+        }
+        const std::uint64_t tx = 2 * static_cast<std::uint64_t>(x);
+        const std::uint64_t td = 2 * static_cast<std::uint64_t>(d);
+        return tx * tx * ay * ay + td * td * ax * ax <= ax * ax * ay * ay;
+    }
+};
+
+template <PixelSurface Surface>
+constexpr void rasterize_ellipse(Surface& cv, const Point centre,
+                                 const int rx, const int ry,
+                                 const pixel_of<Surface> colour,
+                                 const PolygonMode mode, const Rect& clip) {
+    const EllipseRows rows{rx, ry};
+    const Rect box{centre.x - rows.radius_x(), centre.y - rows.radius_y(),
+                   centre.x + rows.radius_x() + 1,
+                   centre.y + rows.radius_y() + 1};
+    const Rect area = clip.intersect(canvas_rect(cv)).intersect(box);
+    if (area.empty()) return;
+
+    for (int y{area.y0}; y < area.y1; y++) {
+        const int d = y - centre.y;
+        const int outer = rows.half_width(d);
+        if (mode == PolygonMode::FILLED) {
+            scanline::span(cv, area, y, centre.x - outer, centre.x + outer,
+                           colour);
+            continue;
+        }
+        const int inner =
+            std::min(outer, rows.half_width(d < 0 ? 1 - d : d + 1) + 1);
+        if (inner == 0) {
+            scanline::span(cv, area, y, centre.x - outer, centre.x + outer,
+                           colour);
+        } else {
+            scanline::span(cv, area, y, centre.x - outer, centre.x - inner,
+                           colour);
+            scanline::span(cv, area, y, centre.x + inner, centre.x + outer,
+                           colour);
+        }
+    }
+}
+
+template <PixelSurface Surface>
+void rasterize_circle(Surface& cv, const Point centre, const int radius,
+                      const pixel_of<Surface> colour,
+                      const PolygonMode mode = PolygonMode::OUTLINE) {
+    rasterize_ellipse(cv, centre, radius, radius, colour, mode,
+                      canvas_rect(cv));
+}
+
+#endif  // ELLIPSE_RASTER_H
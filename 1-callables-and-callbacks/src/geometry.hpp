@@ -0,0 +1,79 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include "canvas.hpp"
+
+// Integer pixel position, x is the column and y is the row
+struct Point {
+    int x{0}, y{0};
+};
+
+// Half open rectangle [x0, x1) x [y0, y1) in canvas coordinates
+struct Rect {
+    int x0{0}, y0{0}, x1{0}, y1{0};
+
+    constexpr bool empty() const { return x0 >= x1 || y0 >= y1; }
+    constexpr bool contains(const int x, const int y) const {
+        return x >= x0 && x < x1 && y >= y0 && y < y1;
+    }
+    constexpr Rect intersect(const Rect& other) const {
+        return {std::max(x0, other.x0), std::max(y0, other.y0),
+                std::min(x1, other.x1), std::min(y1, other.y1)};
+    }
+};
+
+// Rect from 64 bit edges clamped to the int range, for bounds whose edges
+// can pass it. What the clamp cuts off lies outside every canvas.
+constexpr Rect clamped_rect(const std::int64_t x0, const std::int64_t y0,
+                            const std::int64_t x1, const std::int64_t y1) {
+    auto clamp = [](const std::int64_t v) {
+        return static_cast<int>(
+            std::clamp<std::int64_t>(v, std::numeric_limits<int>::min(),
+                                     std::numeric_limits<int>::max()));
+    };
+    return {clamp(x0), clamp(y0), clamp(x1), clamp(y1)};
+}
+
+// Anything the rasterizers can draw on: a size, clipped row spans and
+// unchecked single pixel writes
+template <typename S>
+concept PixelSurface = requires(S& s, const std::size_t i,
+                                const typename S::pixel_type p) {
+    { s.get_width() } -> std::convertible_to<std::size_t>;
+    { s.get_height() } -> std::convertible_to<std::size_t>;
+    s.fill_row_segment(i, i, i, p);
+    s.at(i, i) = p;
+};
+
+template <typename S>
+using pixel_of = typename S::pixel_type;
+
+template <typename Surface>
+constexpr Rect canvas_rect(const Surface& cv) {
+    return {0, 0, static_cast<int>(cv.get_width()),
+            static_cast<int>(cv.get_height())};
+}
+
+// Writes through at() are not tracked, so rasterizers writing single
+// pixels mark the area they wrote once, r already inside the surface.
+// Surfaces without dirty tracking have nothing to mark.
+template <typename Surface>
+constexpr void mark_written(Surface& cv, const Rect& r) {
+    if constexpr (requires(const std::size_t i) {
+                      cv.mark_dirty_rows(i, i, i, i);
+                  }) {
+        if (r.empty()) return;
+        cv.mark_dirty_rows(static_cast<std::size_t>(r.y0),
+                           static_cast<std::size_t>(r.y1),
+                           static_cast<std::size_t>(r.x0),
+                           static_cast<std::size_t>(r.x1));
+    }
+}
+
+#endif  // GEOMETRY_H
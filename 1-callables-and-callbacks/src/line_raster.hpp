@@ -0,0 +1,213 @@
+#ifndef LINE_RASTER_H
+#define LINE_RASTER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+
+#include "canvas.hpp"
+#include "geometry.hpp"
+
+// Integer Bresenham lines between arbitrary end points.
+// Step i along the major axis lands on minor axis offset
+//   q(i) = floor((2 * i * d_minor + d_major) / (2 * d_major))
+// which is what the usual error term walk produces. Because q(i) has a
+// closed form the line is clipped up front, Liang-Barsky style but in
+// integer step space: the first and last steps inside the clip rectangle
+// are solved for directly and the walk starts mid line with its error term
+// already set. The inner loop then writes pixels without bounds checks,
+// and a clipped line is always the same pixels as the unclipped one.
+// Horizontal and vertical lines, and the horizontal runs of shallow lines,
+// are written as spans. End points may be anywhere in the int range.
+namespace line_detail {
+
+struct QuotRem {
+    std::int64_t quot{0}, rem{0};
+};
+
+// (a * b + c) / d for a, b, c >= 0 and d > 0, with a quotient that fits.
+// Deltas reach 2^32, so a * b can pass 64 bits when both axes of a line
+// are that long; those are divided in 128 bits, a bit at a time.
+inline QuotRem mul_add_div(const std::int64_t a, const std::int64_t b,
+                           const std::int64_t c, const std::int64_t d) {
+    constexpr auto max = std::numeric_limits<std::int64_t>::max();
+    if (b == 0 || a <= (max - c) / b) {
+        const std::int64_t n = a * b + c;
+        return {n / d, n % d};
+    }
+    using U = std::uint64_t;
+    const U a_lo = U(a) & 0xffffffff, a_hi = U(a) >> 32;
+    const U b_lo = U(b) & 0xffffffff, b_hi = U(b) >> 32;
+    const U mid_a = a_hi * b_lo, mid_b = a_lo * b_hi;
+    U lo = a_lo * b_lo;
+    const U mid = (lo >> 32) + (mid_a & 0xffffffff) + (mid_b & 0xffffffff);
+    U hi = a_hi * b_hi + (mid_a >> 32) + (mid_b >> 32) + (mid >> 32);
+    lo = (lo & 0xffffffff) | (mid << 32);
+    lo += U(c);
+    if (lo < U(c)) hi++;
+    U quot{0}, rem{hi};
+    for (int bit{63}; bit >= 0; bit--) {
+        rem = (rem << 1) | ((lo >> bit) & 1);
+        quot <<= 1;
+        if (rem >= U(d)) {
+            rem -= U(d);
+            quot |= 1;
+        }
+    }
+    return {static_cast<std::int64_t>(quot), static_cast<std::int64_t>(rem)};
+}
+
+struct StepRange {
+    std::int64_t first{0}, last{-1};
+};
+
+// Steps i in [0, d] whose coordinate start + s * i is in [lo, hi]
+inline StepRange axis_steps(const int start, const int s, const int lo,
+                            const int hi, const std::int64_t d) {
+    StepRange r{0, d};
+    if (s > 0) {
+        r.first = std::max(r.first, std::int64_t{lo} - start);
+        r.last = std::min(r.last, std::int64_t{hi} - start);
+    } else {
+        r.first = std::max(r.first, std::int64_t{start} - hi);
+        r.last = std::min(r.last, std::int64_t{start} - lo);
+    }
+    return r;
+}
+
+// Narrows r to the steps whose minor offset q(i) lies in [q_lo, q_hi],
+// both >= 0: q(i) >= q_lo once 2 i d_minor >= d_major (2 q_lo - 1), and
+// q(i) <= q_hi while 2 i d_minor < d_major (2 q_hi + 1).
+inline void minor_steps(StepRange& r, const std::int64_t q_lo,
+                        const std::int64_t q_hi, const std::int64_t d_major,
+                        const std::int64_t d_minor) {
+    if (d_minor == 0) {
+        if (q_lo > 0 || q_hi < 0) r.last = r.first - 1;
+        return;
+    }
+    const std::int64_t two_minor = 2 * d_minor;
+    if (q_lo > 0) {
+        const QuotRem first =
+            mul_add_div(d_major, 2 * q_lo - 1, two_minor - 1, two_minor);
+        r.first = std::max(r.first, first.quot);
+    }
+    const QuotRem last =
+        mul_add_div(d_major, 2 * q_hi, d_major - 1, two_minor);
+    r.last = std::min(r.last, last.quot);
+}
+
+}  // namespace line_detail
+
+template <PixelSurface Surface>
+void rasterize_line(Surface& cv, const Point a, const Point b,
+                    const pixel_of<Surface> colour, const Rect& clip) {
+    using namespace line_detail;
+    const Rect area = clip.intersect(canvas_rect(cv));
+    if (area.empty()) return;
+
+    const std::int64_t dx = std::abs(std::int64_t{b.x} - a.x);
+    const std::int64_t dy = std::abs(std::int64_t{b.y} - a.y);
+    const int sx = b.x >= a.x ? 1 : -1;
+    const int sy = b.y >= a.y ? 1 : -1;
+
+    if (dy == 0) {
+        if (a.y < area.y0 || a.y >= area.y1) return;
+        const int first = std::max(std::min(a.x, b.x), area.x0);
+        const int last = std::min(std::max(a.x, b.x), area.x1 - 1);
+        if (first <= last) cv.fill_row_segment(a.y, first, last + 1, colour);
+        return;
+    }
+    if (dx == 0) {
+        if (a.x < area.x0 || a.x >= area.x1) return;
+        const int first = std::max(std::min(a.y, b.y), area.y0);
+        const int last = std::min(std::max(a.y, b.y), area.y1 - 1);
+        for (int y{first}; y <= last; y++) cv.at(a.x, y) = colour;
+        mark_written(cv, {a.x, first, a.x + 1, last + 1});
+        return;
+    }
+
+    const bool x_major = dx >= dy;
+    const std::int64_t d_major = x_major ? dx : dy;
+    const std::int64_t d_minor = x_major ? dy : dx;
+
+    // clip against the major axis directly and the minor axis through q(i)
+    StepRange steps = x_major
+                          ? axis_steps(a.x, sx, area.x0, area.x1 - 1, d_major)
+                          : axis_steps(a.y, sy, area.y0, area.y1 - 1, d_major);
+    const StepRange minor =
+        x_major ? axis_steps(a.y, sy, area.y0, area.y1 - 1, d_minor)
+                : axis_steps(a.x, sx, area.x0, area.x1 - 1, d_minor);
+    if (minor.first > minor.last) return;
+    minor_steps(steps, minor.first, minor.last, d_major, d_minor);
+    if (steps.first > steps.last) return;
+
+    // error term at the first visible step, (2 i d_minor + d_major) split
+    // into q(i) and the remainder
+    const std::int64_t two_major = 2 * d_major;
+    const QuotRem start =
+        mul_add_div(steps.first, 2 * d_minor, d_major, two_major);
+    std::int64_t q = start.quot;
+    std::int64_t r = start.rem;
+
+    // positions are computed in 64 bits, only the visible ones fit an int
+    auto x_at = [&](const std::int64_t i) {
+        return static_cast<int>(a.x + sx * i);
+    };
+    auto y_at = [&](const std::int64_t i) {
+        return static_cast<int>(a.y + sy * i);
+    };
+    if (x_major) {
+        // shallow line: gather each row's run of pixels into one span
+        int run_start = x_at(steps.first);
+        int run_end = run_start;
+        int y = y_at(q);
+        auto flush = [&] {
+            cv.fill_row_segment(y, std::min(run_start, run_end),
+                                std::max(run_start, run_end) + 1, colour);
+        };
+        for (std::int64_t i{steps.first}; i <= steps.last; i++) {
+            const int x = x_at(i);
+            const int row = y_at(q);
+            if (row != y) {
+                flush();
+                y = row;
+                run_start = x;
+            }
+            run_end = x;
+            r += 2 * d_minor;
+            if (r >= two_major) {
+                r -= two_major;
+                q++;
+            }
+        }
+        flush();
+    } else {
+        // steep line: one pixel a row, the box of the visible part is
+        // marked once at the end
+        const int x_first = x_at(q);
+        int x{x_first};
+        for (std::int64_t i{steps.first}; i <= steps.last; i++) {
+            x = x_at(q);
+            cv.at(x, y_at(i)) = colour;
+            r += 2 * d_minor;
+            if (r >= two_major) {
+                r -= two_major;
+                q++;
+            }
+        }
+        const int y_first = y_at(steps.first);
+        const int y_last = y_at(steps.last);
+        mark_written(cv, {std::min(x_first, x), std::min(y_first, y_last),
+                          std::max(x_first, x) + 1,
+                          std::max(y_first, y_last) + 1});
+    }
+}
+
+template <PixelSurface Surface>
+void rasterize_line(Surface& cv, const Point a, const Point b,
+                    const pixel_of<Surface> colour) {
+    rasterize_line(cv, a, b, colour, canvas_rect(cv));
+}
+
+#endif  // LINE_RASTER_H
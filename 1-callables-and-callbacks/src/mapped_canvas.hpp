@@ -0,0 +1,195 @@
+#ifndef MAPPED_CANVAS_H
+#define MAPPED_CANVAS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <span>
+#include <type_traits>
+
+#include "canvas.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CANVAS_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define CANVAS_HAS_MMAP 0
+#endif
+
+// Layout of a canvas file: this header, then width * height pixels row
+// after row. The header is 64 bytes so the pixels start cache line aligned.
+struct MappedCanvasHeader {
+    char magic[8];             // "CANVAS1"
+    std::uint32_t pixel_size;  // sizeof(Pixel)
+    std::uint32_t data_offset;
+    std::uint64_t width, height;
+    std::uint8_t reserved[32];
+};
+static_assert(sizeof(MappedCanvasHeader) == 64);
+
+// A canvas whose pixels live in a memory mapped file, so it can be larger
+// than RAM (the kernel pages rows in and out) and other processes can map
+// the same file to read the result without a copy.
+//   create()  makes or truncates the file, all pixels zero
+//   open()    maps an existing file read only or read write
+//   sync()    flushes written pixels to the file (msync)
+// canvas() hands the pixels out as an ordinary shared_ptr<BasicCanvas>, so
+// myDrawer and anything else taking a CanvasDrawer can draw on it; the
+// mapping stays alive while any such pointer does. Read only mappings
+// only hand out const canvases. Failures return nullptr / false.
+// Only available where mmap is (CANVAS_HAS_MMAP).
+template <typename Pixel = int>
+class MappedCanvas
+    : public std::enable_shared_from_this<MappedCanvas<Pixel>> {
+    static_assert(std::is_trivially_copyable_v<Pixel>);
+
+   public:
+    enum class Mode : std::uint8_t { READ_ONLY = 0x01, READ_WRITE = 0x02 };
+
+    static std::shared_ptr<MappedCanvas> create(const char* path,
+                                                const std::size_t w,
+                                                const std::size_t h) {
+#if CANVAS_HAS_MMAP
+        // file_size() would wrap, and the canvas outgrow its mapping
+        constexpr auto max_length =
+            static_cast<std::size_t>(std::numeric_limits<off_t>::max());
+        if (!fits(w, h, max_length)) return nullptr;
+        const int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return nullptr;
+        const std::size_t length = file_size(w, h);
+        // ftruncate zero fills, so every pixel starts as Pixel{} for the
+        // integer pixel types
+        if (::ftruncate(fd, static_cast<off_t>(length)) != 0) {
+            ::close(fd);
+            return nullptr;
+        }
+        auto mapped = map(fd, length, Mode::READ_WRITE);
+        if (!mapped) return nullptr;
+        auto* header = static_cast<MappedCanvasHeader*>(mapped->address);
+        std::memcpy(header->magic, "CANVAS1", 8);
+        header->pixel_size = sizeof(Pixel);
+        header->data_offset = sizeof(MappedCanvasHeader);
+        header->width = w;
+        header->height = h;
+        mapped->attach(w, h);
+        return mapped;
+#else
+        (void)path, (void)w, (void)h;
+        return nullptr;
+#endif
+    }
+
+    static std::shared_ptr<MappedCanvas> open(const char* path,
+                                              const Mode mode) {
+#if CANVAS_HAS_MMAP
+        const bool writable = mode == Mode::READ_WRITE;
+        const int fd = ::open(path, writable ? O_RDWR : O_RDONLY);
+        if (fd < 0) return nullptr;
+        struct stat info {};
+        if (::fstat(fd, &info) != 0 ||
+            static_cast<std::size_t>(info.st_size) <
+                sizeof(MappedCanvasHeader)) {
+            ::close(fd);
+            return nullptr;
+        }
+        const auto length = static_cast<std::size_t>(info.st_size);
+        auto mapped = map(fd, length, mode);
+        if (!mapped) return nullptr;
+        const auto* header =
+            static_cast<const MappedCanvasHeader*>(mapped->address);
+        const bool valid =
+            std::memcmp(header->magic, "CANVAS1", 8) == 0 &&
+            header->pixel_size == sizeof(Pixel) &&
+            header->data_offset == sizeof(MappedCanvasHeader) &&
+            fits(header->width, header->height, length);
+        if (!valid) return nullptr;
+        mapped->attach(header->width, header->height);
+        return mapped;
+#else
+        (void)path, (void)mode;
+        return nullptr;
+#endif
+    }
+
+    MappedCanvas(const MappedCanvas&) = delete;
+    MappedCanvas& operator=(const MappedCanvas&) = delete;
+
+    ~MappedCanvas() {
+#if CANVAS_HAS_MMAP
+        if (address != nullptr) ::munmap(address, length);
+#endif
+    }
+
+    bool is_read_only() const { return mode == Mode::READ_ONLY; }
+
+    // Pixels as a canvas sharing ownership of the mapping, nullptr when the
+    // mapping is read only
+    std::shared_ptr<BasicCanvas<Pixel>> canvas() {
+        if (is_read_only()) return nullptr;
+        return {this->shared_from_this(), &view};
+    }
+    std::shared_ptr<const BasicCanvas<Pixel>> const_canvas() const {
+        return {this->shared_from_this(), &view};
+    }
+
+    // Writes dirty pages back to the file, waiting for them unless async.
+    // Returns true on success.
+    bool sync(const bool async = false) const {
+#if CANVAS_HAS_MMAP
+        if (is_read_only()) return true;
+        return ::msync(address, length, async ? MS_ASYNC : MS_SYNC) == 0;
+#else
+        (void)async;
+        return false;
+#endif
+    }
+
+   private:
+    void* address{nullptr};
+    std::size_t length{0};
+    Mode mode{Mode::READ_ONLY};
+    BasicCanvas<Pixel> view{0, 0};
+
+    // Only the factories make one, once the file is mapped
+    MappedCanvas(void* addr, const std::size_t len, const Mode m)
+        : address{addr}, length{len}, mode{m} {}
+
+    static std::size_t file_size(const std::size_t w, const std::size_t h) {
+        return sizeof(MappedCanvasHeader) + w * h * sizeof(Pixel);
+    }
+
+    // Whether a w x h canvas fits in a file of length bytes, without
+    // trusting w * h not to overflow
+    static bool fits(const std::uint64_t w, const std::uint64_t h,
+                     const std::size_t length) {
+        const std::size_t room = length - sizeof(MappedCanvasHeader);
+        return h == 0 || w <= room / sizeof(Pixel) / h;
+    }
+
+#if CANVAS_HAS_MMAP
+    // Maps the whole file and closes fd, the mapping keeps the file open
+    static std::shared_ptr<MappedCanvas> map(const int fd,
+                                             const std::size_t len,
+                                             const Mode m) {
+        const int protection =
+            m == Mode::READ_WRITE ? PROT_READ | PROT_WRITE : PROT_READ;
+        void* addr = ::mmap(nullptr, len, protection, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED) return nullptr;
+        return std::shared_ptr<MappedCanvas>(new MappedCanvas(addr, len, m));
+    }
+#endif
+
+    void attach(const std::size_t w, const std::size_t h) {
+        auto* pixels = reinterpret_cast<Pixel*>(static_cast<char*>(address) +
+                                                sizeof(MappedCanvasHeader));
+        view = BasicCanvas<Pixel>(std::span<Pixel>(pixels, w * h), w, h);
+    }
+};
+
+#endif  // MAPPED_CANVAS_H
@@ -0,0 +1,338 @@
+#ifndef RGBA_CANVAS_H
+#define RGBA_CANVAS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "canvas.hpp"
+#include "canvas_kernels.hpp"
+
+// 8 bit per channel RGBA canvases in two layouts:
+//   INTERLEAVED  RgbaCanvas, a BasicCanvas<Rgba8>. The four channels of a
+//                pixel sit together, which is the layout images are
+//                exported and blitted in.
+//   PLANAR       PlanarRgbaCanvas, one Canvas8 sized plane per channel.
+//                A per channel operation, e.g. masking the alpha, streams
+//                through a single plane with the 8 bit vector kernels
+//                instead of touching every fourth byte.
+// Both satisfy PixelSurface, so the shape rasterizers draw on either.
+// to_planar / to_interleaved convert between them with vector transposes.
+enum class RgbaLayout : std::uint8_t { INTERLEAVED = 0x01, PLANAR = 0x02 };
+
+enum class RgbaChannel : std::uint8_t {
+    RED = 0x00,
+    GREEN = 0x01,
+    BLUE = 0x02,
+    ALPHA = 0x03
+};
+
+struct Rgba8 {
+    std::uint8_t r{0}, g{0}, b{0}, a{0};
+
+    // Transparent black, the background pixel
+    constexpr Rgba8() = default;
+    constexpr Rgba8(const std::uint8_t red, const std::uint8_t green,
+                    const std::uint8_t blue, const std::uint8_t alpha = 255)
+        : r{red}, g{green}, b{blue}, a{alpha} {}
+
+    // Packed as 0xRRGGBBAA, which is how a DrawCommand carries a colour
+    constexpr explicit Rgba8(const std::uint32_t packed)
+        : r{static_cast<std::uint8_t>(packed >> 24)},
+          g{static_cast<std::uint8_t>(packed >> 16)},
+          b{static_cast<std::uint8_t>(packed >> 8)},
+          a{static_cast<std::uint8_t>(packed)} {}
+    constexpr std::uint32_t packed() const {
+        return std::uint32_t{r} << 24 | std::uint32_t{g} << 16 |
+               std::uint32_t{b} << 8 | a;
+    }
+    constexpr explicit operator std::int32_t() const {
+        return static_cast<std::int32_t>(packed());
+    }
+
+    constexpr std::uint8_t channel(const RgbaChannel c) const {
+        switch (c) {
+            case RgbaChannel::RED:
+                return r;
+            case RgbaChannel::GREEN:
+                return g;
+            case RgbaChannel::BLUE:
+                return b;
+            case RgbaChannel::ALPHA:
+                break;
+        }
+        return a;
+    }
+
+    friend constexpr bool operator==(Rgba8, Rgba8) = default;
+};
+
+// The conversion kernels treat a run of pixels as bytes R G B A R G ...
+static_assert(sizeof(Rgba8) == 4 && std::is_trivially_copyable_v<Rgba8>);
+
+using RgbaCanvas = BasicCanvas<Rgba8>;
+
+// The interface follows BasicCanvas, except that at() returns a proxy and
+// rows are exposed per channel. Plane c starts at byte c * width * height.
+class PlanarRgbaCanvas {
+   public:
+    using pixel_type = Rgba8;
+
+    static constexpr std::size_t column_alignment{1};
+
+    // Writable reference to the four bytes of one pixel
+    class Reference {
+       public:
+        Reference(std::uint8_t* red, const std::size_t plane_size)
+            : px{red}, n{plane_size} {}
+
+        Reference& operator=(const Rgba8 val) {
+            px[0] = val.r;
+            px[n] = val.g;
+            px[2 * n] = val.b;
+            px[3 * n] = val.a;
+            return *this;
+        }
+        operator Rgba8() const { return {px[0], px[n], px[2 * n], px[3 * n]}; }
+
+       private:
+        std::uint8_t* px;
+        std::size_t n;
+    };
+
+    PlanarRgbaCanvas() = default;
+
+    PlanarRgbaCanvas(const std::size_t w, const std::size_t h)
+        : width{w}, height{h}, data_planes(4 * w * h, 0), dirty{w, h} {}
+
+    void display() const {
+        std::cout << "*************Canvas ID: " << this << " ************\n";
+        for (std::size_t y{0}; y < height; y++) {
+            print_row(y);
+        }
+        std::cout << "*************Canvas ID: " << this << " ************"
+                  << std::endl;
+    }
+
+    // Prints only the rows changed since the dirty state was last cleared,
+    // each prefixed with its row number, then clears it
+    void display_changes() {
+        std::cout << "*************Canvas ID: " << this << " ************\n";
+        const auto rows = dirty.rows();
+        for (std::size_t y{rows.begin}; y < rows.end; y++) {
+            if (dirty.columns(y).empty()) continue;
+            std::cout << y << ':';
+            print_row(y);
+        }
+        std::cout << "*************Canvas ID: " << this << " ************"
+                  << std::endl;
+        clear_dirty();
+    }
+
+    // 0 based index, x is the column and y is the row
+    bool set_coord(const std::size_t x, const std::size_t y, const Rgba8 val) {
+        if (!is_within_bounds(x, y)) return false;
+        at(x, y) = val;
+        dirty.mark(y, x, x + 1);
+        return true;
+    }
+
+    std::optional<Rgba8> get_coord(const std::size_t x,
+                                   const std::size_t y) const {
+        if (!is_within_bounds(x, y)) return std::nullopt;
+        return at(x, y);
+    }
+
+    // Unchecked access for callers that have already clipped to the canvas,
+    // untracked like BasicCanvas::at()
+    Reference at(const std::size_t x, const std::size_t y) {
+        return {data_planes.data() + y * width + x, plane_size()};
+    }
+    Rgba8 at(const std::size_t x, const std::size_t y) const {
+        const std::size_t i = y * width + x;
+        const std::size_t n = plane_size();
+        return {data_planes[i], data_planes[n + i], data_planes[2 * n + i],
+                data_planes[3 * n + i]};
+    }
+
+    // Fills the half open range [x_begin, x_end) of row y, one byte fill
+    // per channel
+    void fill_row_segment(const std::size_t y, const std::size_t x_begin,
+                          std::size_t x_end, const Rgba8 val) {
+        if (y >= height) return;
+        x_end = std::min(x_end, width);
+        if (x_begin >= x_end) return;
+        for (std::size_t c{0}; c < 4; c++) {
+            std::uint8_t* line = plane_data(c) + y * width;
+            std::fill(line + x_begin, line + x_end,
+                      val.channel(static_cast<RgbaChannel>(c)));
+        }
+        dirty.mark(y, x_begin, x_end);
+    }
+
+    // Fills a w x h rectangle with its top left corner at (x, y)
+    void fill_rect(const std::size_t x, const std::size_t y,
+                   const std::size_t w, const std::size_t h,
+                   const Rgba8 val) {
+        if (x >= width || y >= height) return;
+        const std::size_t x_end = x + std::min(w, width - x);
+        const std::size_t y_end = y + std::min(h, height - y);
+        for (std::size_t j{y}; j < y_end; j++) {
+            fill_row_segment(j, x, x_end, val);
+        }
+    }
+
+    void fill(const Rgba8 val) {
+        for (std::size_t c{0}; c < 4; c++) {
+            std::fill(plane_data(c), plane_data(c) + plane_size(),
+                      val.channel(static_cast<RgbaChannel>(c)));
+        }
+        dirty.mark_all();
+    }
+
+    std::size_t get_width() const { return width; }
+    std::size_t get_height() const { return height; }
+
+    // One channel of every pixel, rows back to back. The writable one
+    // marks every row.
+    std::span<std::uint8_t> plane(const RgbaChannel c) {
+        dirty.mark_all();
+        return {plane_data(static_cast<std::size_t>(c)), plane_size()};
+    }
+    std::span<const std::uint8_t> plane(const RgbaChannel c) const {
+        return {plane_data(static_cast<std::size_t>(c)), plane_size()};
+    }
+
+    // One channel of row y, which must be less than the height. The
+    // writable one marks the whole row dirty.
+    std::span<std::uint8_t> plane_row(const RgbaChannel c,
+                                      const std::size_t y) {
+        dirty.mark(y, 0, width);
+        return {plane_data(static_cast<std::size_t>(c)) + y * width, width};
+    }
+    std::span<const std::uint8_t> plane_row(const RgbaChannel c,
+                                            const std::size_t y) const {
+        return {plane_data(static_cast<std::size_t>(c)) + y * width, width};
+    }
+
+    // Dirty tracking, as for BasicCanvas
+    using DirtySpan = DirtyTracker::Span;
+
+    DirtySpan dirty_columns(const std::size_t y) const {
+        return dirty.columns(y);
+    }
+    DirtySpan dirty_row_range() const { return dirty.rows(); }
+    bool is_dirty() const { return dirty.any(); }
+    void set_dirty_tracking(const bool on) { dirty.set_tracking(on); }
+    bool is_dirty_tracking() const { return dirty.is_tracking(); }
+    void mark_dirty(const std::size_t y, const std::size_t x_begin,
+                    const std::size_t x_end) {
+        dirty.mark(y, x_begin, x_end);
+    }
+    void mark_dirty_rows(const std::size_t y_begin, const std::size_t y_end,
+                         const std::size_t x_begin, const std::size_t x_end) {
+        dirty.mark_rows(y_begin, y_end, x_begin, x_end);
+    }
+    void mark_all_dirty() { dirty.mark_all(); }
+    void clear_dirty() { dirty.clear(); }
+
+   private:
+    // Dimensions
+    std::size_t width{16}, height{16};
+    std::vector<std::uint8_t> data_planes =
+        std::vector<std::uint8_t>(4 * width * height);
+    DirtyTracker dirty{width, height};
+
+    std::size_t plane_size() const { return width * height; }
+    std::uint8_t* plane_data(const std::size_t c) {
+        return data_planes.data() + c * plane_size();
+    }
+    const std::uint8_t* plane_data(const std::size_t c) const {
+        return data_planes.data() + c * plane_size();
+    }
+
+    bool is_within_bounds(const std::size_t x, const std::size_t y) const {
+        return x < width && y < height;
+    }
+
+    void print_row(const std::size_t y) const {
+        for (std::size_t x{0}; x < width; x++) {
+            std::cout << (at(x, y) == Rgba8{} ? " . " : " * ");
+        }
+        std::cout << '\n';
+    }
+};
+
+// The canvas type of a layout, for code that picks one per workload
+template <RgbaLayout L>
+using RgbaCanvasOf = std::conditional_t<L == RgbaLayout::PLANAR,
+                                        PlanarRgbaCanvas, RgbaCanvas>;
+
+// Copies src into dst in the other layout, marking all of dst dirty.
+// Returns false, leaving dst alone, when the sizes differ.
+inline bool to_planar(const RgbaCanvas& src, PlanarRgbaCanvas& dst) {
+    if (src.get_width() != dst.get_width() ||
+        src.get_height() != dst.get_height())
+        return false;
+    const auto px = src.pixels();
+    canvas_kernels::deinterleave_rgba(
+        {reinterpret_cast<const std::uint8_t*>(px.data()), 4 * px.size()},
+        dst.plane(RgbaChannel::RED), dst.plane(RgbaChannel::GREEN),
+        dst.plane(RgbaChannel::BLUE), dst.plane(RgbaChannel::ALPHA));
+    return true;
+}
+
+inline bool to_interleaved(const PlanarRgbaCanvas& src, RgbaCanvas& dst) {
+    if (src.get_width() != dst.get_width() ||
+        src.get_height() != dst.get_height())
+        return false;
+    const auto px = dst.pixels();
+    canvas_kernels::interleave_rgba(
+        {reinterpret_cast<std::uint8_t*>(px.data()), 4 * px.size()},
+        src.plane(RgbaChannel::RED), src.plane(RgbaChannel::GREEN),
+        src.plane(RgbaChannel::BLUE), src.plane(RgbaChannel::ALPHA));
+    return true;
+}
+
+inline PlanarRgbaCanvas to_planar(const RgbaCanvas& src) {
+    PlanarRgbaCanvas out(src.get_width(), src.get_height());
+    to_planar(src, out);
+    return out;
+}
+
+inline RgbaCanvas to_interleaved(const PlanarRgbaCanvas& src) {
+    RgbaCanvas out(src.get_width(), src.get_height());
+    to_interleaved(src, out);
+    return out;
+}
+
+namespace canvas_kernels {
+
+// Blends value into channel c of cv by the coverage in alpha, a canvas of
+// the same size, in one vector pass over that plane. Other sizes leave cv
+// unchanged.
+inline void composite(PlanarRgbaCanvas& cv, const RgbaChannel c,
+                      const Canvas8& alpha, const std::uint8_t value) {
+    if (alpha.get_width() != cv.get_width() ||
+        alpha.get_height() != cv.get_height())
+        return;
+    composite(cv.plane(c), alpha.pixels(), value);
+}
+
+// Blends colour over cv by the coverage in alpha, a plane at a time
+inline void composite(PlanarRgbaCanvas& cv, const Canvas8& alpha,
+                      const Rgba8 colour) {
+    for (const RgbaChannel c : {RgbaChannel::RED, RgbaChannel::GREEN,
+                                RgbaChannel::BLUE, RgbaChannel::ALPHA}) {
+        composite(cv, c, alpha, colour.channel(c));
+    }
+}
+
+}  // namespace canvas_kernels
+
+#endif  // RGBA_CANVAS_H
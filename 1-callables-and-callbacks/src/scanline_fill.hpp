@@ -0,0 +1,197 @@
+#ifndef SCANLINE_FILL_H
+#define SCANLINE_FILL_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "canvas.hpp"
+#include "geometry.hpp"
+
+enum class PolygonMode : std::uint8_t { OUTLINE = 0x01, FILLED = 0x02 };
+
+// Edge table scanline rasterizer for polygons.
+// Vertices are pixel centres. Every edge is stored top to bottom with its
+// x position in 16.16 fixed point, and rows are walked top to bottom with
+// an active edge list, stepping each edge's x by its slope once per row.
+// Each row then becomes a handful of horizontal spans written straight
+// into the row buffer:
+//   outline  the pixels an edge crosses within the row, from its x half
+//            a row above to half a row below (clamped to its end points),
+//            so consecutive rows join up without gaps
+//   filled   the even-odd interior between sorted edge crossings, plus the
+//            outline so the filled shape covers its own border
+// Every row only depends on its own y, so any clip rectangle produces the
+// same pixels as drawing the whole polygon. All of it is constexpr, for
+// sprite tables traced at compile time.
+namespace scanline {
+
+constexpr int frac_bits{16};
+constexpr std::int64_t one{std::int64_t{1} << frac_bits};
+constexpr std::int64_t half{one / 2};
+
+// Vertex count that is handled without touching the heap
+constexpr std::size_t inline_vertices{64};
+
+struct Edge {
+    int y_top{0}, y_bottom{0};
+    std::int64_t x_top{0}, x_bottom{0};  // fixed point
+    std::int64_t slope{0};               // fixed point x per row
+    std::int64_t x{0};                   // fixed point x at the current row
+};
+
+constexpr int floor_fx(const std::int64_t v) {
+    return static_cast<int>(v >> frac_bits);
+}
+constexpr int ceil_fx(const std::int64_t v) {
+    return static_cast<int>((v + one - 1) >> frac_bits);
+}
+constexpr int round_fx(const std::int64_t v) {
+    return static_cast<int>((v + half) >> frac_bits);
+}
+
+// Fills the inclusive columns [first, last] of row y inside clip
+template <PixelSurface Surface>
+constexpr void span(Surface& cv, const Rect& clip, const int y, int first,
+                    int last, const pixel_of<Surface> colour) {
+    first = std::max(first, clip.x0);
+    last = std::min(last, clip.x1 - 1);
+    if (first > last) return;
+    cv.fill_row_segment(static_cast<std::size_t>(y),
+                        static_cast<std::size_t>(first),
+                        static_cast<std::size_t>(last) + 1, colour);
+}
+
+// Builds the edge table sorted by top row, returns the number of edges
+constexpr std::size_t build_edges(std::span<const Point> vertices,
+                                  std::span<Edge> edges) {
+    std::size_t count{0};
+    for (std::size_t i{0}; i < vertices.size(); i++) {
+        Point a = vertices[i];
+        Point b = vertices[(i + 1) % vertices.size()];
+        if (b.y < a.y) std::swap(a, b);
+        Edge& e = edges[count++];
+        e.y_top = a.y;
+        e.y_bottom = b.y;
+        e.x_top = a.x * one;
+        e.x_bottom = b.x * one;
+        e.slope = a.y == b.y ? 0 : (e.x_bottom - e.x_top) / (b.y - a.y);
+    }
+    std::sort(edges.begin(), edges.begin() + count,
+              [](const Edge& l, const Edge& r) { return l.y_top < r.y_top; });
+    return count;
+}
+
+template <PixelSurface Surface>
+constexpr void fill_edges(Surface& cv, std::span<Edge> edges,
+                          std::span<Edge*> active,
+                          std::span<std::int64_t> crossings,
+                          const pixel_of<Surface> colour,
+                          const PolygonMode mode, const Rect& area) {
+    std::size_t next{0}, active_count{0};
+    for (int y{area.y0}; y < area.y1; y++) {
+        // retire finished edges, step the rest down one row
+        std::size_t kept{0};
+        for (std::size_t i{0}; i < active_count; i++) {
+            Edge* e = active[i];
+            if (e->y_bottom < y) continue;
+            e->x += e->slope;
+            active[kept++] = e;
+        }
+        active_count = kept;
+        // activate edges starting on (or, for the first row, above) y
+        while (next < edges.size() && edges[next].y_top <= y) {
+            Edge& e = edges[next++];
+            if (e.y_bottom < y) continue;
+            e.x = e.x_top + (y - e.y_top) * e.slope;
+            active[active_count++] = &e;
+        }
+
+        if (mode == PolygonMode::FILLED) {
+            std::size_t n{0};
+            for (std::size_t i{0}; i < active_count; i++) {
+                const Edge* e = active[i];
+                if (e->y_top <= y && y < e->y_bottom) crossings[n++] = e->x;
+            }
+            std::sort(crossings.begin(), crossings.begin() + n);
+            for (std::size_t i{0}; i + 1 < n; i += 2) {
+                span(cv, area, y, ceil_fx(crossings[i]),
+                     floor_fx(crossings[i + 1]), colour);
+            }
+        }
+
+        // outline
+        for (std::size_t i{0}; i < active_count; i++) {
+            const Edge* e = active[i];
+            if (e->y_top == e->y_bottom) {
+                span(cv, area, y, round_fx(std::min(e->x_top, e->x_bottom)),
+                     round_fx(std::max(e->x_top, e->x_bottom)), colour);
+                continue;
+            }
+            const bool last_row = y == e->y_bottom;
+            const int upper =
+                round_fx(y == e->y_top ? e->x_top : e->x - e->slope / 2);
+            int lower = round_fx(last_row ? e->x_bottom : e->x + e->slope / 2);
+            // the pixel where this row meets the next one belongs to the
+            // next row, so shallow edges come out one pixel thick
+            if (!last_row && lower != upper) lower += lower > upper ? -1 : 1;
+            span(cv, area, y, std::min(upper, lower), std::max(upper, lower),
+                 colour);
+        }
+    }
+}
+
+}  // namespace scanline
+
+// Smallest rectangle holding every vertex
+constexpr Rect polygon_bounds(std::span<const Point> vertices) {
+    if (vertices.empty()) return {};
+    Rect r{vertices[0].x, vertices[0].y, vertices[0].x + 1, vertices[0].y + 1};
+    for (const auto& p : vertices) {
+        r.x0 = std::min(r.x0, p.x);
+        r.y0 = std::min(r.y0, p.y);
+        r.x1 = std::max(r.x1, p.x + 1);
+        r.y1 = std::max(r.y1, p.y + 1);
+    }
+    return r;
+}
+
+// Draws the closed polygon through vertices, restricted to clip
+template <PixelSurface Surface>
+constexpr void rasterize_polygon(Surface& cv, std::span<const Point> vertices,
+                                 const pixel_of<Surface> colour,
+                                 const PolygonMode mode, const Rect& clip) {
+    const Rect area =
+        clip.intersect(canvas_rect(cv)).intersect(polygon_bounds(vertices));
+    if (area.empty()) return;
+
+    const std::size_t n = vertices.size();
+    if (n <= scanline::inline_vertices) {
+        std::array<scanline::Edge, scanline::inline_vertices> edges;
+        std::array<scanline::Edge*, scanline::inline_vertices> active;
+        std::array<std::int64_t, scanline::inline_vertices> crossings;
+        const auto count = scanline::build_edges(vertices, edges);
+        scanline::fill_edges(cv, std::span(edges.data(), count), active,
+                             crossings, colour, mode, area);
+    } else {
+        std::vector<scanline::Edge> edges(n);
+        std::vector<scanline::Edge*> active(n);
+        std::vector<std::int64_t> crossings(n);
+        const auto count = scanline::build_edges(vertices, edges);
+        scanline::fill_edges(cv, std::span(edges.data(), count),
+                             std::span(active), std::span(crossings), colour,
+                             mode, area);
+    }
+}
+
+template <PixelSurface Surface>
+void rasterize_polygon(Surface& cv, std::span<const Point> vertices,
+                       const pixel_of<Surface> colour,
+                       const PolygonMode mode = PolygonMode::OUTLINE) {
+    rasterize_polygon(cv, vertices, colour, mode, canvas_rect(cv));
+}
+
+#endif  // SCANLINE_FILL_H
@@ -0,0 +1,389 @@
+#ifndef SHAPE_RASTER_H
+#define SHAPE_RASTER_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <numbers>
+#include <span>
+#include <utility>
+
+#include "canvas.hpp"
+#include "ellipse_raster.hpp"
+#include "geometry.hpp"
+#include "line_raster.hpp"
+#include "scanline_fill.hpp"
+#include "shape_sprites.hpp"
+
+enum class Shape : std::uint8_t {
+    SQUARE = 0x01,
+    TRIANGLE = 0x02,
+    CIRCLE = 0x03,
+    TRAPEZIUM = 0x04,
+    POLYGON = 0x05,
+    RHOMBUS = 0x06,
+    KITE = 0x07,
+    LINE = 0x08,
+    POINT = 0x09,
+    CIRCLE_V2 = 0x10
+};
+
+// One recorded shape. The parameters depend on the shape:
+//   SQUARE             outline of the box with corners (x0, y0), (x1, y1)
+//   TRIANGLE, TRAPEZIUM, RHOMBUS, KITE, POLYGON
+//                      fitted to the box with corners (x0, y0), (x1, y1),
+//                      POLYGON is regular with `sides` sides
+// `mode` selects outline or filled for polygons, circles and ellipses.
+//   LINE               from (x0, y0) to (x1, y1)
+//   CIRCLE, CIRCLE_V2  centre (x0, y0) and radius x1, a non zero y1 is
+//                      the vertical radius of an ellipse
+//   POINT              the pixel (x0, y0)
+struct DrawCommand {
+    Shape shape{Shape::POINT};
+    std::int32_t colour{1};
+    std::int32_t x0{0}, y0{0}, x1{0}, y1{0};
+    PolygonMode mode{PolygonMode::OUTLINE};
+    std::uint16_t sides{6};
+};
+
+// Most vertices a recorded POLYGON is allowed
+constexpr std::uint16_t max_polygon_sides{scanline::inline_vertices};
+
+// Every Shape, in declaration order
+constexpr std::array all_shapes{
+    Shape::SQUARE,  Shape::TRIANGLE, Shape::CIRCLE, Shape::TRAPEZIUM,
+    Shape::POLYGON, Shape::RHOMBUS,  Shape::KITE,   Shape::LINE,
+    Shape::POINT,   Shape::CIRCLE_V2};
+
+// Entries in a table indexed by a Shape's value. Slot 0 names no shape.
+constexpr std::size_t shape_slots{
+    static_cast<std::size_t>(std::ranges::max(all_shapes)) + 1};
+
+// Builds a table holding entry.operator()<S>() in the slot of every shape S
+// and fallback everywhere else. This is how the runtime Shape overloads
+// reach the compile time ones without a switch.
+template <typename T, typename Entry>
+consteval std::array<T, shape_slots> make_shape_table(const T fallback,
+                                                       Entry entry) {
+    std::array<T, shape_slots> table{};
+    table.fill(fallback);
+    [&]<std::size_t... I>(std::index_sequence<I...>) {
+        ((table[static_cast<std::size_t>(all_shapes[I])] =
+              entry.template operator()<all_shapes[I]>()),
+         ...);
+    }(std::make_index_sequence<all_shapes.size()>{});
+    return table;
+}
+
+// The entry for shape, the fallback for values that name no shape
+template <typename T>
+constexpr T shape_entry(const std::array<T, shape_slots>& table,
+                        const Shape shape) {
+    const auto slot = static_cast<std::size_t>(shape);
+    return table[slot < shape_slots ? slot : 0];
+}
+
+constexpr bool is_polygonal(const Shape shape) {
+    switch (shape) {
+        case Shape::TRIANGLE:
+        case Shape::TRAPEZIUM:
+        case Shape::POLYGON:
+        case Shape::RHOMBUS:
+        case Shape::KITE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+constexpr bool is_circular(const Shape shape) {
+    return shape == Shape::CIRCLE || shape == Shape::CIRCLE_V2;
+}
+
+// Vertices of a polygonal command of shape S, clockwise from the top.
+// Returns the number written into out, 0 for other shapes.
+template <Shape S>
+constexpr std::size_t shape_vertices(const DrawCommand& cmd,
+                           std::span<Point, max_polygon_sides> out) {
+    const int left = std::min(cmd.x0, cmd.x1);
+    const int right = std::max(cmd.x0, cmd.x1);
+    const int top = std::min(cmd.y0, cmd.y1);
+    const int bottom = std::max(cmd.y0, cmd.y1);
+    const int mid_x = left + (right - left) / 2;
+    const int mid_y = top + (bottom - top) / 2;
+    std::size_t n{0};
+    auto vertex = [&](const int x, const int y) { out[n++] = {x, y}; };
+
+    if constexpr (S == Shape::TRIANGLE) {
+        // apex on the top edge, base along the bottom
+        vertex(mid_x, top);
+        vertex(right, bottom);
+        vertex(left, bottom);
+    } else if constexpr (S == Shape::TRAPEZIUM) {
+        // top side half as wide as the base
+        vertex(left + (right - left) / 4, top);
+        vertex(right - (right - left) / 4, top);
+        vertex(right, bottom);
+        vertex(left, bottom);
+    } else if constexpr (S == Shape::RHOMBUS) {
+        vertex(mid_x, top);
+        vertex(right, mid_y);
+        vertex(mid_x, bottom);
+        vertex(left, mid_y);
+    } else if constexpr (S == Shape::KITE) {
+        // cross bar a third of the way down
+        vertex(mid_x, top);
+        vertex(right, top + (bottom - top) / 3);
+        vertex(mid_x, bottom);
+        vertex(left, top + (bottom - top) / 3);
+    } else if constexpr (S == Shape::POLYGON) {
+        // regular polygon inscribed in the box's ellipse
+        const int sides = std::clamp<int>(cmd.sides, 3, max_polygon_sides);
+        const double rx = (right - left) / 2.0;
+        const double ry = (bottom - top) / 2.0;
+        const double cx = left + rx, cy = top + ry;
+        for (int k{0}; k < sides; k++) {
+            const double angle =
+                -std::numbers::pi / 2 + 2 * std::numbers::pi * k / sides;
+            const auto x = std::lround(cx + rx * std::cos(angle));
+            const auto y = std::lround(cy + ry * std::sin(angle));
+            vertex(static_cast<int>(x), static_cast<int>(y));
+        }
+    }
+    return n;
+}
+
+inline std::size_t shape_vertices(const DrawCommand& cmd,
+                                  std::span<Point, max_polygon_sides> out) {
+    using Fn = std::size_t (*)(const DrawCommand&,
+                               std::span<Point, max_polygon_sides>);
+    static constexpr auto table = make_shape_table<Fn>(
+        [](const DrawCommand&, std::span<Point, max_polygon_sides>) {
+            return std::size_t{0};
+        },
+        []<Shape S>() -> Fn { return &shape_vertices<S>; });
+    return shape_entry(table, cmd.shape)(cmd, out);
+}
+
+// Draws shape S with mode, R pixels either side of the centre, on a sprite
+// mask. Regular POLYGONs need trigonometry, which is not constexpr, so
+// they have no sprites.
+template <Shape S, PolygonMode M>
+    requires(is_circular(S) || (is_polygonal(S) && S != Shape::POLYGON))
+struct ShapeTrace {
+    template <int R>
+    static constexpr void trace(sprite::Mask<R>& mask) {
+        if constexpr (is_circular(S)) {
+            rasterize_ellipse(mask, {R, R}, R, R, 1, M, canvas_rect(mask));
+        } else {
+            const DrawCommand cmd{S, 1, 0, 0, 2 * R, 2 * R, M};
+            std::array<Point, max_polygon_sides> vertices{};
+            const auto n = shape_vertices<S>(cmd, vertices);
+            rasterize_polygon(mask, std::span<const Point>(vertices.data(), n),
+                              1, M, canvas_rect(mask));
+        }
+    }
+};
+
+// Sprites of shape S at the given radii, e.g.
+//   ShapeSprites<Shape::KITE, PolygonMode::FILLED, 2, 4, 8>::stamp(cv,
+//       {x, y}, 4, colour)
+// draws what a KITE command with corners (x - 4, y - 4), (x + 4, y + 4)
+// would.
+template <Shape S, PolygonMode M, int... Radii>
+using ShapeSprites = SpriteSet<ShapeTrace<S, M>, Radii...>;
+
+// Circles up to this radius are stamped from sprites by rasterize()
+constexpr int max_sprite_radius{15};
+
+template <PolygonMode M, int... R>
+ShapeSprites<Shape::CIRCLE, M, R...> circle_sprites_of(
+    std::integer_sequence<int, R...>);
+
+template <PolygonMode M>
+using CircleSprites = decltype(circle_sprites_of<M>(
+    std::make_integer_sequence<int, max_sprite_radius + 1>{}));
+
+// Draw policy of one shape: bounds() is the area a command can touch,
+// used to bin commands by screen region, and rasterize() draws the command
+// into area, which already lies inside the canvas and the bounds.
+template <typename R, typename Surface>
+concept ShapeRasterizer =
+    PixelSurface<Surface> &&
+    requires(Surface& cv, const DrawCommand& cmd, const Rect& area,
+             pixel_of<Surface> colour) {
+        { R::shape } -> std::convertible_to<Shape>;
+        { R::bounds(cmd) } -> std::same_as<Rect>;
+        R::rasterize(cv, cmd, area, colour);
+    };
+
+template <Shape S>
+struct ShapeRaster;
+
+template <>
+struct ShapeRaster<Shape::SQUARE> {
+    static constexpr Shape shape{Shape::SQUARE};
+
+    static Rect bounds(const DrawCommand& cmd) {
+        return clamped_rect(std::min(cmd.x0, cmd.x1), std::min(cmd.y0, cmd.y1),
+                            std::int64_t{std::max(cmd.x0, cmd.x1)} + 1,
+                            std::int64_t{std::max(cmd.y0, cmd.y1)} + 1);
+    }
+
+    template <PixelSurface Surface>
+    static void rasterize(Surface& cv, const DrawCommand& cmd,
+                          const Rect& area, const pixel_of<Surface> colour) {
+        const int left = std::min(cmd.x0, cmd.x1);
+        const int right = std::max(cmd.x0, cmd.x1);
+        const int top = std::min(cmd.y0, cmd.y1);
+        const int bottom = std::max(cmd.y0, cmd.y1);
+        // top and bottom widths
+        for (const int y : {top, bottom}) {
+            if (y >= area.y0 && y < area.y1)
+                cv.fill_row_segment(y, area.x0, area.x1, colour);
+        }
+        // left and right heights
+        for (int y{area.y0}; y < area.y1; y++) {
+            if (left >= area.x0) cv.at(left, y) = colour;
+            if (right < area.x1) cv.at(right, y) = colour;
+        }
+        if (left >= area.x0)
+            mark_written(cv, {left, area.y0, left + 1, area.y1});
+        if (right < area.x1)
+            mark_written(cv, {right, area.y0, right + 1, area.y1});
+    }
+};
+
+template <Shape S>
+    requires(is_polygonal(S))
+struct ShapeRaster<S> {
+    static constexpr Shape shape{S};
+
+    static Rect bounds(const DrawCommand& cmd) {
+        return ShapeRaster<Shape::SQUARE>::bounds(cmd);
+    }
+
+    template <PixelSurface Surface>
+    static void rasterize(Surface& cv, const DrawCommand& cmd,
+                          const Rect& area, const pixel_of<Surface> colour) {
+        std::array<Point, max_polygon_sides> vertices;
+        const auto n = shape_vertices<S>(cmd, vertices);
+        rasterize_polygon(cv, std::span<const Point>(vertices.data(), n),
+                          colour, cmd.mode, area);
+    }
+};
+
+template <Shape S>
+    requires(is_circular(S))
+struct ShapeRaster<S> {
+    static constexpr Shape shape{S};
+
+    static Rect bounds(const DrawCommand& cmd) {
+        const std::int64_t rx = cmd.x1;
+        const std::int64_t ry = cmd.y1 > 0 ? cmd.y1 : cmd.x1;
+        return clamped_rect(cmd.x0 - rx, cmd.y0 - ry, cmd.x0 + rx + 1,
+                            cmd.y0 + ry + 1);
+    }
+
+    // Small circles come from the sprite tables
+    template <PixelSurface Surface>
+    static void rasterize(Surface& cv, const DrawCommand& cmd,
+                          const Rect& area, const pixel_of<Surface> colour) {
+        const bool round = cmd.y1 <= 0 || cmd.y1 == cmd.x1;
+        if (round && cmd.x1 <= max_sprite_radius) {
+            const Point centre{cmd.x0, cmd.y0};
+            const bool stamped =
+                cmd.mode == PolygonMode::FILLED
+                    ? CircleSprites<PolygonMode::FILLED>::stamp(
+                          cv, centre, cmd.x1, colour, area)
+                    : CircleSprites<PolygonMode::OUTLINE>::stamp(
+                          cv, centre, cmd.x1, colour, area);
+            if (stamped) return;
+        }
+        rasterize_ellipse(cv, {cmd.x0, cmd.y0}, cmd.x1,
+                          cmd.y1 > 0 ? cmd.y1 : cmd.x1, colour, cmd.mode,
+                          area);
+    }
+};
+
+template <>
+struct ShapeRaster<Shape::LINE> {
+    static constexpr Shape shape{Shape::LINE};
+
+    static Rect bounds(const DrawCommand& cmd) {
+        return ShapeRaster<Shape::SQUARE>::bounds(cmd);
+    }
+
+    template <PixelSurface Surface>
+    static void rasterize(Surface& cv, const DrawCommand& cmd,
+                          const Rect& area, const pixel_of<Surface> colour) {
+        rasterize_line(cv, {cmd.x0, cmd.y0}, {cmd.x1, cmd.y1}, colour, area);
+    }
+};
+
+template <>
+struct ShapeRaster<Shape::POINT> {
+    static constexpr Shape shape{Shape::POINT};
+
+    static Rect bounds(const DrawCommand& cmd) {
+        return clamped_rect(cmd.x0, cmd.y0, std::int64_t{cmd.x0} + 1,
+                            std::int64_t{cmd.y0} + 1);
+    }
+
+    template <PixelSurface Surface>
+    static void rasterize(Surface& cv, const DrawCommand& cmd, const Rect&,
+                          const pixel_of<Surface> colour) {
+        cv.at(cmd.x0, cmd.y0) = colour;
+        mark_written(cv, {cmd.x0, cmd.y0, cmd.x0 + 1, cmd.y0 + 1});
+    }
+};
+
+// Area a command can touch, used to bin commands by screen region
+inline Rect bounds(const DrawCommand& cmd) {
+    using Fn = Rect (*)(const DrawCommand&);
+    static constexpr auto table = make_shape_table<Fn>(
+        &ShapeRaster<Shape::POINT>::bounds,
+        []<Shape S>() -> Fn { return &ShapeRaster<S>::bounds; });
+    return shape_entry(table, cmd.shape)(cmd);
+}
+
+// Rasterizes cmd as a shape S known at compile time, cmd.shape is not
+// read. The shape's loops are specialised and inlined into the caller,
+// which pays off when drawing many small shapes.
+template <Shape S, PixelSurface Surface>
+    requires ShapeRasterizer<ShapeRaster<S>, Surface>
+void rasterize(Surface& cv, const DrawCommand& cmd, const Rect& clip) {
+    const Rect area =
+        clip.intersect(canvas_rect(cv)).intersect(ShapeRaster<S>::bounds(cmd));
+    if (area.empty()) return;
+    ShapeRaster<S>::rasterize(cv, cmd, area,
+                              static_cast<pixel_of<Surface>>(cmd.colour));
+}
+
+template <Shape S, PixelSurface Surface>
+void rasterize(Surface& cv, const DrawCommand& cmd) {
+    rasterize<S>(cv, cmd, canvas_rect(cv));
+}
+
+// Rasterizes cmd into the part of the canvas inside clip. Drawing the same
+// command over several disjoint clip rectangles writes exactly the pixels
+// a single unclipped call would. Looks the shape up in a table of the
+// compile time rasterizers.
+template <PixelSurface Surface>
+void rasterize(Surface& cv, const DrawCommand& cmd, const Rect& clip) {
+    using Fn = void (*)(Surface&, const DrawCommand&, const Rect&);
+    static constexpr auto table = make_shape_table<Fn>(
+        [](Surface&, const DrawCommand&, const Rect&) {},
+        []<Shape S>() -> Fn { return &rasterize<S, Surface>; });
+    shape_entry(table, cmd.shape)(cv, cmd, clip);
+}
+
+template <PixelSurface Surface>
+void rasterize(Surface& cv, const DrawCommand& cmd) {
+    rasterize(cv, cmd, canvas_rect(cv));
+}
+
+#endif  // SHAPE_RASTER_H
@@ -0,0 +1,175 @@
+#ifndef SHAPE_SPRITES_H
+#define SHAPE_SPRITES_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+#include "geometry.hpp"
+
+// Precomputed span tables for small shapes drawn at a few fixed sizes.
+// A sprite lists the horizontal runs a shape covers, relative to its
+// centre. It is traced at compile time by running the ordinary constexpr
+// rasterizer on a small mask, so it holds exactly the pixels a direct draw
+// writes. Stamping a sprite writes each run with one fill_row_segment, a
+// memset style fill, instead of re-running the midpoint or edge walk.
+// Runs are clipped like any other span, so a clipped stamp also matches a
+// clipped draw.
+// SpriteSet<Trace, Radii...> holds one sprite per radius (half size) of a
+// shape, see ShapeSprites in shape_raster.hpp for the shapes themselves.
+
+// Row dy from the centre, columns [x_begin, x_end) from the centre
+struct SpriteSpan {
+    std::int16_t dy{0};
+    std::int16_t x_begin{0}, x_end{0};
+};
+
+namespace sprite {
+
+// The (2R + 1) square surface a sprite of radius R is traced on, centred
+// on (R, R)
+template <int R>
+class Mask {
+   public:
+    using pixel_type = std::uint8_t;
+    static constexpr std::size_t side{2 * R + 1};
+
+    constexpr std::size_t get_width() const { return side; }
+    constexpr std::size_t get_height() const { return side; }
+
+    constexpr void fill_row_segment(const std::size_t y,
+                                    const std::size_t x_begin,
+                                    const std::size_t x_end,
+                                    const pixel_type p) {
+        for (std::size_t x{x_begin}; x < std::min(x_end, side); x++) {
+            at(x, y) = p;
+        }
+    }
+    constexpr pixel_type& at(const std::size_t x, const std::size_t y) {
+        return bits[y * side + x];
+    }
+    constexpr pixel_type at(const std::size_t x, const std::size_t y) const {
+        return bits[y * side + x];
+    }
+
+   private:
+    std::array<pixel_type, side * side> bits{};
+};
+
+// Calls f(dy, x_begin, x_end) for every run of set pixels, top to bottom
+template <int R, typename F>
+constexpr void for_each_run(const Mask<R>& mask, F&& f) {
+    constexpr int side{static_cast<int>(Mask<R>::side)};
+    for (int y{0}; y < side; y++) {
+        int x{0};
+        while (x < side) {
+            if (mask.at(x, y) == 0) {
+                x++;
+                continue;
+            }
+            const int begin{x};
+            while (x < side && mask.at(x, y) != 0) x++;
+            f(y - R, begin - R, x - R);
+        }
+    }
+}
+
+template <typename Trace, int R>
+constexpr std::size_t count_spans() {
+    Mask<R> mask;
+    Trace::trace(mask);
+    std::size_t n{0};
+    for_each_run(mask, [&n](int, int, int) { n++; });
+    return n;
+}
+
+template <typename Trace, int R, std::size_t N>
+constexpr std::array<SpriteSpan, N> collect_spans() {
+    Mask<R> mask;
+    Trace::trace(mask);
+    std::array<SpriteSpan, N> spans{};
+    std::size_t n{0};
+    for_each_run(mask, [&](const int dy, const int begin, const int end) {
+        spans[n++] = {static_cast<std::int16_t>(dy),
+                      static_cast<std::int16_t>(begin),
+                      static_cast<std::int16_t>(end)};
+    });
+    return spans;
+}
+
+// Trace::trace(Mask<R>&) draws the shape centred on the mask
+template <typename Trace, int R>
+struct Sprite {
+    static_assert(R >= 0 && R < 1024, "sprites are for small shapes");
+    static constexpr std::size_t size{count_spans<Trace, R>()};
+    static constexpr std::array<SpriteSpan, size> spans{
+        collect_spans<Trace, R, size>()};
+};
+
+}  // namespace sprite
+
+// Writes spans with their centre on centre, clipped to clip and the
+// surface
+template <PixelSurface Surface>
+constexpr void stamp(Surface& cv, std::span<const SpriteSpan> spans,
+                     const Point centre, const pixel_of<Surface> colour,
+                     const Rect& clip) {
+    const Rect area = clip.intersect(canvas_rect(cv));
+    for (const SpriteSpan& s : spans) {
+        const int y = centre.y + s.dy;
+        if (y < area.y0 || y >= area.y1) continue;
+        const int x_begin = std::max(centre.x + s.x_begin, area.x0);
+        const int x_end = std::min(centre.x + s.x_end, area.x1);
+        if (x_begin >= x_end) continue;
+        cv.fill_row_segment(static_cast<std::size_t>(y),
+                            static_cast<std::size_t>(x_begin),
+                            static_cast<std::size_t>(x_end), colour);
+    }
+}
+
+template <PixelSurface Surface>
+constexpr void stamp(Surface& cv, std::span<const SpriteSpan> spans,
+                     const Point centre, const pixel_of<Surface> colour) {
+    stamp(cv, spans, centre, colour, canvas_rect(cv));
+}
+
+// Sprites of one shape at the radii Radii..., all traced at compile time
+template <typename Trace, int... Radii>
+class SpriteSet {
+   public:
+    static constexpr std::array<int, sizeof...(Radii)> radii{Radii...};
+
+    // The sprite of radius r, nullopt when r is not in the set
+    static constexpr std::optional<std::span<const SpriteSpan>> find(
+        const int r) {
+        constexpr std::array<std::span<const SpriteSpan>, sizeof...(Radii)>
+            table{std::span<const SpriteSpan>(
+                sprite::Sprite<Trace, Radii>::spans)...};
+        for (std::size_t i{0}; i < radii.size(); i++) {
+            if (radii[i] == r) return table[i];
+        }
+        return std::nullopt;
+    }
+
+    // Stamps the sprite of radius r centred on centre. Returns false, and
+    // draws nothing, when r is not in the set.
+    template <PixelSurface Surface>
+    static constexpr bool stamp(Surface& cv, const Point centre, const int r,
+                                const pixel_of<Surface> colour,
+                                const Rect& clip) {
+        const auto spans = find(r);
+        if (!spans) return false;
+        ::stamp(cv, *spans, centre, colour, clip);
+        return true;
+    }
+    template <PixelSurface Surface>
+    static constexpr bool stamp(Surface& cv, const Point centre, const int r,
+                                const pixel_of<Surface> colour) {
+        return stamp(cv, centre, r, colour, canvas_rect(cv));
+    }
+};
+
+#endif  // SHAPE_SPRITES_H
@@ -0,0 +1,291 @@
+#ifndef SPARSE_CANVAS_H
+#define SPARSE_CANVAS_H
+
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "canvas_kernels.hpp"
+
+// A canvas for very large, mostly empty surfaces. Pixels live in 64 x 64
+// chunks that are only allocated once something other than the background
+// Pixel{} is written to them; everywhere else reads as Pixel{}.
+// Chunks are found through a two level page table: the canvas holds one
+// pointer per page of 32 x 32 chunks, and a page is allocated the first
+// time one of its chunks is. A 100k x 100k canvas therefore starts at a
+// few thousand null pointers rather than 40 GB.
+// It has the set_coord / get_coord / display interface of BasicCanvas and
+// satisfies PixelSurface, so the shape rasterizers draw on it directly.
+// for_each_chunk() visits only the allocated chunks, which is how masking
+// (canvas_kernels::scale) and CanvasEncoder::encode_chunks skip the empty
+// space. Writes allocate, so one canvas must not be drawn on from several
+// threads at once.
+template <typename Pixel = int>
+class SparseCanvas {
+   public:
+    using pixel_type = Pixel;
+
+    static constexpr std::size_t chunk_size{64};  // pixels per chunk side
+    static constexpr std::size_t page_size{32};   // chunks per page side
+
+    // One allocated chunk. Rows are chunk_size apart in data; width and
+    // height are smaller than chunk_size on the right and bottom edges.
+    template <typename T>
+    struct BasicChunkView {
+        std::size_t x0{0}, y0{0};  // canvas position of the top left pixel
+        std::size_t width{0}, height{0};
+        T* data{nullptr};
+
+        std::span<T> row(const std::size_t y) const {
+            return {data + y * chunk_size, width};
+        }
+    };
+    using ChunkView = BasicChunkView<const Pixel>;
+    using MutableChunkView = BasicChunkView<Pixel>;
+
+    SparseCanvas(const std::size_t w, const std::size_t h)
+        : width{w},
+          height{h},
+          chunks_x{ceil_div(w, chunk_size)},
+          chunks_y{ceil_div(h, chunk_size)},
+          pages_x{ceil_div(chunks_x, page_size)},
+          pages(pages_x * ceil_div(chunks_y, page_size)) {}
+
+    void display() const {
+        std::cout << "*************Canvas ID: " << this << " ************\n";
+        for (std::size_t y{0}; y < height; y++) {
+            for (std::size_t cx{0}; cx < chunks_x; cx++) {
+                const std::size_t x0 = cx * chunk_size;
+                const std::size_t n = std::min(chunk_size, width - x0);
+                const Chunk* chunk = find(cx, y / chunk_size);
+                for (std::size_t i{0}; i < n; i++) {
+                    const bool set =
+                        chunk != nullptr &&
+                        chunk->pixels[(y % chunk_size) * chunk_size + i] !=
+                            Pixel{};
+                    std::cout << (set ? " * " : " . ");
+                }
+            }
+            std::cout << '\n';
+        }
+        std::cout << "*************Canvas ID: " << this << " ************"
+                  << std::endl;
+    }
+
+    // 0 based index, x is the column and y is the row
+    bool set_coord(const std::size_t x, const std::size_t y,
+                   const Pixel val) {  // returns true if set is successful
+        if (!is_within_bounds(x, y)) return false;
+        if (val == Pixel{} && find(x / chunk_size, y / chunk_size) == nullptr)
+            return true;
+        at(x, y) = val;
+        return true;
+    }
+
+    std::optional<Pixel> get_coord(const std::size_t x,
+                                   const std::size_t y) const {
+        if (!is_within_bounds(x, y)) return std::nullopt;
+        return at(x, y);
+    }
+
+    // Unchecked access for callers that have already clipped to the canvas.
+    // The writable one allocates the pixel's chunk.
+    Pixel& at(const std::size_t x, const std::size_t y) {
+        return acquire(x / chunk_size, y / chunk_size)
+            .pixels[offset(x, y)];
+    }
+    Pixel at(const std::size_t x, const std::size_t y) const {
+        const Chunk* chunk = find(x / chunk_size, y / chunk_size);
+        return chunk == nullptr ? Pixel{} : chunk->pixels[offset(x, y)];
+    }
+
+    // Fills the half open range [x_begin, x_end) of row y. Background
+    // fills leave unallocated chunks alone.
+    void fill_row_segment(const std::size_t y, std::size_t x_begin,
+                          std::size_t x_end, const Pixel val) {
+        if (y >= height) return;
+        x_end = std::min(x_end, width);
+        const std::size_t cy = y / chunk_size;
+        while (x_begin < x_end) {
+            const std::size_t cx = x_begin / chunk_size;
+            const std::size_t end = std::min(x_end, (cx + 1) * chunk_size);
+            Chunk* chunk =
+                val == Pixel{} ? find_mutable(cx, cy) : &acquire(cx, cy);
+            if (chunk != nullptr) {
+                Pixel* line = chunk->pixels.data() + offset(0, y);
+                std::fill(line + x_begin % chunk_size,
+                          line + (end - 1) % chunk_size + 1, val);
+            }
+            x_begin = end;
+        }
+    }
+
+    // Fills a w x h rectangle with its top left corner at (x, y)
+    void fill_rect(const std::size_t x, const std::size_t y,
+                   const std::size_t w, const std::size_t h,
+                   const Pixel val) {
+        if (x >= width || y >= height) return;
+        const std::size_t x_end = x + std::min(w, width - x);
+        const std::size_t y_end = y + std::min(h, height - y);
+        for (std::size_t j{y}; j < y_end; j++) {
+            fill_row_segment(j, x, x_end, val);
+        }
+    }
+
+    // Filling with the background releases every chunk, anything else
+    // makes the canvas dense
+    void fill(const Pixel val) {
+        if (val == Pixel{}) {
+            for (auto& page : pages) page.reset();
+            allocated = 0;
+            return;
+        }
+        fill_rect(0, 0, width, height, val);
+    }
+
+    std::size_t get_width() const { return width; }
+    std::size_t get_height() const { return height; }
+
+    // Number of allocated chunks and the pixel memory they hold
+    std::size_t chunk_count() const { return allocated; }
+    std::size_t chunk_bytes() const { return allocated * sizeof(Chunk); }
+
+    // Calls fn(view) for every allocated chunk, in page order
+    template <typename Fn>
+    void for_each_chunk(Fn&& fn) const {
+        visit(*this, std::forward<Fn>(fn));
+    }
+    template <typename Fn>
+    void for_each_chunk(Fn&& fn) {
+        visit(*this, std::forward<Fn>(fn));
+    }
+
+    // Frees the chunks that only hold the background
+    void release_empty_chunks() {
+        for (auto& page : pages) {
+            if (!page) continue;
+            std::size_t live{0};
+            for (auto& chunk : page->chunks) {
+                if (!chunk) continue;
+                const bool empty =
+                    std::all_of(chunk->pixels.begin(), chunk->pixels.end(),
+                                [](const Pixel& p) { return p == Pixel{}; });
+                if (empty) {
+                    chunk.reset();
+                    allocated--;
+                } else {
+                    live++;
+                }
+            }
+            if (live == 0) page.reset();
+        }
+    }
+
+   private:
+    struct Chunk {
+        std::array<Pixel, chunk_size * chunk_size> pixels{};
+    };
+    struct Page {
+        std::array<std::unique_ptr<Chunk>, page_size * page_size> chunks;
+    };
+
+    std::size_t width, height;
+    std::size_t chunks_x, chunks_y, pages_x;
+    std::vector<std::unique_ptr<Page>> pages;
+    std::size_t allocated{0};
+
+    static constexpr std::size_t ceil_div(const std::size_t a,
+                                          const std::size_t b) {
+        return (a + b - 1) / b;
+    }
+    static constexpr std::size_t offset(const std::size_t x,
+                                        const std::size_t y) {
+        return (y % chunk_size) * chunk_size + x % chunk_size;
+    }
+
+    bool is_within_bounds(const std::size_t x, const std::size_t y) const {
+        return x < width && y < height;
+    }
+
+    std::size_t page_index(const std::size_t cx, const std::size_t cy) const {
+        return (cy / page_size) * pages_x + cx / page_size;
+    }
+    static std::size_t slot(const std::size_t cx, const std::size_t cy) {
+        return (cy % page_size) * page_size + cx % page_size;
+    }
+
+    const Chunk* find(const std::size_t cx, const std::size_t cy) const {
+        const auto& page = pages[page_index(cx, cy)];
+        return page ? page->chunks[slot(cx, cy)].get() : nullptr;
+    }
+    Chunk* find_mutable(const std::size_t cx, const std::size_t cy) {
+        auto& page = pages[page_index(cx, cy)];
+        return page ? page->chunks[slot(cx, cy)].get() : nullptr;
+    }
+
+    Chunk& acquire(const std::size_t cx, const std::size_t cy) {
+        auto& page = pages[page_index(cx, cy)];
+        if (!page) page = std::make_unique<Page>();
+        auto& chunk = page->chunks[slot(cx, cy)];
+        if (!chunk) {
+            chunk = std::make_unique<Chunk>();
+            allocated++;
+        }
+        return *chunk;
+    }
+
+    // Shared by the const and mutable for_each_chunk
+    template <typename Self, typename Fn>
+    static void visit(Self& self, Fn&& fn) {
+        using T = std::conditional_t<std::is_const_v<Self>, const Pixel,
+                                     Pixel>;
+        for (std::size_t p{0}; p < self.pages.size(); p++) {
+            if (!self.pages[p]) continue;
+            const std::size_t px = p % self.pages_x, py = p / self.pages_x;
+            for (std::size_t s{0}; s < page_size * page_size; s++) {
+                auto& chunk = self.pages[p]->chunks[s];
+                if (!chunk) continue;
+                const std::size_t cx = px * page_size + s % page_size;
+                const std::size_t cy = py * page_size + s / page_size;
+                BasicChunkView<T> view;
+                view.x0 = cx * chunk_size;
+                view.y0 = cy * chunk_size;
+                view.width = std::min(chunk_size, self.width - view.x0);
+                view.height = std::min(chunk_size, self.height - view.y0);
+                view.data = chunk->pixels.data();
+                fn(view);
+            }
+        }
+    }
+};
+
+namespace canvas_kernels {
+
+// Masking a sparse canvas only touches its allocated chunks, the
+// background stays Pixel{} under scaling
+template <typename Pixel>
+void scale(SparseCanvas<Pixel>& cv, Pixel factor) {
+    cv.for_each_chunk([factor](const auto& chunk) {
+        for (std::size_t y{0}; y < chunk.height; y++) {
+            const auto line = chunk.row(y);
+            if constexpr (std::same_as<Pixel, std::int32_t>) {
+                scale(line, factor);
+            } else {
+                for (auto& p : line) p = static_cast<Pixel>(p * factor);
+            }
+        }
+    });
+}
+
+}  // namespace canvas_kernels
+
+#endif  // SPARSE_CANVAS_H
@@ -0,0 +1,192 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// A small fork-join pool for data parallel loops.
+// parallel_for(n, fn) deals the indices [0, n) out to per thread queues in
+// contiguous blocks. Each thread drains its own queue from the front and,
+// once empty, steals from the back of the others, so uneven work (e.g.
+// tiles crowded with shapes next to empty ones) still keeps every core
+// busy. The calling thread takes part and returns once all indices ran.
+// A parallel_for called from inside one of the pool's own tasks runs its
+// indices inline on that thread, the pool being busy with the outer loop.
+class WorkStealingPool {
+   public:
+    // Worker threads in addition to the calling thread
+    explicit WorkStealingPool(
+        const std::size_t workers = default_worker_count()) {
+        queues.reserve(workers + 1);
+        for (std::size_t i{0}; i <= workers; i++) {
+            queues.push_back(std::make_unique<Queue>());
+        }
+        threads.reserve(workers);
+        for (std::size_t i{0}; i < workers; i++) {
+            threads.emplace_back([this, i] { worker_loop(i + 1); });
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard lock{state_lock};
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& t : threads) t.join();
+    }
+
+    static std::size_t default_worker_count() {
+        const auto hw = std::thread::hardware_concurrency();
+        return hw > 1 ? hw - 1 : 0;
+    }
+
+    // Threads that run tasks, including the caller
+    std::size_t size() const { return queues.size(); }
+
+    // Calls fn(i) for every i in [0, n) and blocks until all calls return.
+    // The first exception thrown by fn is rethrown here.
+    template <typename Fn>
+    void parallel_for(const std::size_t n, Fn&& fn) {
+        if (n == 0) return;
+        if (running_task == this) {
+            run_inline(n, fn);
+            return;
+        }
+        std::lock_guard job_guard{job_lock};
+
+        using F = std::remove_reference_t<Fn>;
+        job_context = const_cast<void*>(static_cast<const void*>(&fn));
+        job_call = [](void* ctx, std::size_t i) { (*static_cast<F*>(ctx))(i); };
+        job_error = nullptr;
+        remaining.store(n, std::memory_order_relaxed);
+
+        // contiguous blocks keep neighbouring indices on the same thread
+        const std::size_t block = (n + queues.size() - 1) / queues.size();
+        for (std::size_t q{0}; q < queues.size(); q++) {
+            std::lock_guard lock{queues[q]->lock};
+            const std::size_t first = std::min(n, q * block);
+            const std::size_t last = std::min(n, first + block);
+            for (std::size_t i{first}; i < last; i++) {
+                queues[q]->items.push_back(i);
+            }
+        }
+        {
+            std::lock_guard lock{state_lock};
+            generation++;
+        }
+        wake.notify_all();
+
+        run_until_empty(0);
+        std::unique_lock lock{state_lock};
+        done.wait(lock, [this] {
+            return remaining.load(std::memory_order_acquire) == 0;
+        });
+        if (job_error) std::rethrow_exception(job_error);
+    }
+
+   private:
+    struct alignas(64) Queue {
+        std::mutex lock;
+        std::deque<std::size_t> items;
+    };
+
+    // queues[0] belongs to the calling thread, queues[i] to threads[i - 1]
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex job_lock;
+    void* job_context{nullptr};
+    void (*job_call)(void*, std::size_t){nullptr};
+    std::exception_ptr job_error;
+    std::atomic<std::size_t> remaining{0};
+
+    std::mutex state_lock;
+    std::condition_variable wake, done;
+    std::size_t generation{0};
+    bool stopping{false};
+
+    // The pool whose task this thread is running, if any. job_lock is held
+    // for the whole outer loop, so a nested loop must not take it again.
+    static inline thread_local const WorkStealingPool* running_task{nullptr};
+
+    template <typename Fn>
+    static void run_inline(const std::size_t n, Fn& fn) {
+        std::exception_ptr error;
+        for (std::size_t i{0}; i < n; i++) {
+            try {
+                fn(i);
+            } catch (...) {
+                if (!error) error = std::current_exception();
+            }
+        }
+        if (error) std::rethrow_exception(error);
+    }
+
+    bool pop_local(const std::size_t q, std::size_t& item) {
+        std::lock_guard lock{queues[q]->lock};
+        if (queues[q]->items.empty()) return false;
+        item = queues[q]->items.front();
+        queues[q]->items.pop_front();
+        return true;
+    }
+
+    bool steal(const std::size_t thief, std::size_t& item) {
+        for (std::size_t k{1}; k < queues.size(); k++) {
+            auto& victim = *queues[(thief + k) % queues.size()];
+            std::lock_guard lock{victim.lock};
+            if (victim.items.empty()) continue;
+            item = victim.items.back();
+            victim.items.pop_back();
+            return true;
+        }
+        return false;
+    }
+
+    void run_until_empty(const std::size_t q) {
+        const WorkStealingPool* const outer = running_task;
+        running_task = this;
+        std::size_t item{0};
+        while (pop_local(q, item) || steal(q, item)) {
+            try {
+                job_call(job_context, item);
+            } catch (...) {
+                std::lock_guard lock{state_lock};
+                if (!job_error) job_error = std::current_exception();
+            }
+            if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard lock{state_lock};
+                done.notify_all();
+            }
+        }
+        running_task = outer;
+    }
+
+    void worker_loop(const std::size_t q) {
+        std::size_t seen{0};
+        for (;;) {
+            {
+                std::unique_lock lock{state_lock};
+                wake.wait(lock,
+                          [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+            }
+            run_until_empty(q);
+        }
+    }
+};
+
+#endif  // WORK_STEALING_POOL_H